@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include "src/cdict.hpp"
 #include "src/dict.hpp"
 #include "src/io.hpp"
 #include "src/kmath.hpp"
@@ -7,6 +7,7 @@
 #include "src/ktime.hpp"     
 #include "src/seq.hpp"       
 #include "src/thr.hpp"
+#include "src/cdict.hpp"
 #include "src/dict.hpp"      
 #include "src/io.hpp"        
 #include "src/krandom.hpp"   
@@ -96,34 +96,33 @@ namespace argparse {
             unsigned helpCols=60
             );
 
-    /*! Return an ArgHolder object holding the parsed arguments.
-     *
-     * @param argc,argv
-     *      The arguments to main().
-     * @param optToChker
-     *      Should map an option string (anything beginning with `optChar`) to a
-     *      checker function that takes a vector of argument strings and returns
-     *      the number of arguments read. The function should also throw an
-     *      `invalid_argument` exception if any arguments are invalid. For
-     *      example, a simple help option checker:
-     *
-     *          makeDict(string("-h"), [](vector<string> args) { return 0; })
-     * @param optChar
-     *      Signifies the start of an option.
-     * @param genHelpChker
-     *      If `true`, checks "-h" and "--help" options automatically.
-     *
-     * @throws invalid_argument
-     *      Thrown if unknown option is encountered, as well as if a checker throws
-     *      an `invalid_argument` exception.
+    /*! makeUsageString() with the help strings in a `dict::StaticDict`. */
+    template <size_t N>
+    string makeUsageString(
+            const string &progName,
+            const string &desc,
+            const string &posArgs,
+            const dict::StaticDict<const char *, N> &optToHelp,
+            unsigned cols=80,
+            unsigned helpCols=60
+            ) {
+        dict::Dict<string, string> helps;
+        for (const auto &entry : optToHelp) {
+            helps[entry.key] = entry.val;
+        }
+        return makeUsageString(progName, desc, posArgs, helps, cols, helpCols);
+    }
+
+    /*! Shared implementation of the parse() overloads taking an option to
+     * checker mapping. `DictT` only needs `at()`.
      */
-    template <class FuncType> 
-    ArgHolder parse(
+    template <class DictT>
+    ArgHolder _parse(
             int argc,
             const char *argv[],
-            const dict::Dict<string, FuncType> &optToChker,
-            char optChar='-',
-            bool genHelpChker=true
+            const DictT &optToChker,
+            char optChar,
+            bool genHelpChker
             ) {
         ArgHolder holder{dict::Dict<string, vector<string>>(), vector<string>()};
 
@@ -172,6 +171,60 @@ namespace argparse {
         return holder;
     }
 
+    /*! Return an ArgHolder object holding the parsed arguments.
+     *
+     * @param argc,argv
+     *      The arguments to main().
+     * @param optToChker
+     *      Should map an option string (anything beginning with `optChar`) to a
+     *      checker function that takes a vector of argument strings and returns
+     *      the number of arguments read. The function should also throw an
+     *      `invalid_argument` exception if any arguments are invalid. For
+     *      example, a simple help option checker:
+     *
+     *          makeDict(string("-h"), [](vector<string> args) { return 0; })
+     * @param optChar
+     *      Signifies the start of an option.
+     * @param genHelpChker
+     *      If `true`, checks "-h" and "--help" options automatically.
+     *
+     * @throws invalid_argument
+     *      Thrown if unknown option is encountered, as well as if a checker throws
+     *      an `invalid_argument` exception.
+     */
+    template <class FuncType>
+    ArgHolder parse(
+            int argc,
+            const char *argv[],
+            const dict::Dict<string, FuncType> &optToChker,
+            char optChar='-',
+            bool genHelpChker=true
+            ) {
+        return _parse(argc, argv, optToChker, optChar, genHelpChker);
+    }
+
+    /*! parse() with the checkers in a `dict::StaticDict`, so the option table
+     * is built at compile time. The checkers must then be plain functions,
+     * for example:
+     *
+     *          unsigned chkHelp(vector<string> args) { return 0; }
+     *          constexpr dict::StaticEntry<unsigned (*)(vector<string>)> CHKERS[] = {
+     *              {"-h", chkHelp}
+     *          };
+     *          constexpr auto optToChker = dict::makeStaticDict(CHKERS);
+     *          argparse::parse(argc, argv, optToChker);
+     */
+    template <class FuncType, size_t N>
+    ArgHolder parse(
+            int argc,
+            const char *argv[],
+            const dict::StaticDict<FuncType, N> &optToChker,
+            char optChar='-',
+            bool genHelpChker=true
+            ) {
+        return _parse(argc, argv, optToChker, optChar, genHelpChker);
+    }
+
     /*! For programs that take no options.
      *
      * See parse() above.
@@ -0,0 +1,402 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "dict.hpp"
+#include "seq.hpp"
+#include "thr.hpp"
+
+using namespace std;
+
+/* The parts of `dict` built on `thr` and `seq::execution`, kept apart so that
+ * including dict.hpp doesn't pull in threads.
+ */
+namespace dict {
+    /*! Snapshot of one shard of a `ConcurrentDict`. The lock counters stay 0
+     * unless the dict's `StatsT` is `ShardStatsRecorder`.
+     */
+    struct ShardStats {
+        /*! Number of entries in the shard. */
+        size_t size;
+        /*! Number of times the shard was locked for reading. */
+        unsigned long reads;
+        /*! Number of times the shard was locked for writing. */
+        unsigned long writes;
+        /*! Number of those reads and writes that found the lock taken and had
+         * to wait.
+         */
+        unsigned long contended;
+    };
+
+    /*! Collects the lock counters of `ShardStats`, when passed as a
+     * `ConcurrentDict`'s `StatsT`. Each lock of a shard then also bumps a
+     * counter on the shard's cache line, so keep it to debugging.
+     */
+    class ShardStatsRecorder {
+    private:
+        atomic<unsigned long> reads;
+        atomic<unsigned long> writes;
+        atomic<unsigned long> contended;
+
+    public:
+        ShardStatsRecorder() : reads(0), writes(0), contended(0) {}
+
+        void locked(bool exclusive, bool waited) {
+            (exclusive ? this->writes : this->reads).fetch_add(1, memory_order_relaxed);
+            if (waited) {
+                this->contended.fetch_add(1, memory_order_relaxed);
+            }
+        }
+
+        void snapshot(ShardStats &out) const {
+            out.reads = this->reads.load(memory_order_relaxed);
+            out.writes = this->writes.load(memory_order_relaxed);
+            out.contended = this->contended.load(memory_order_relaxed);
+        }
+    };
+
+    /*! Default `StatsT` of `ConcurrentDict`: counts nothing, so locking a
+     * shard writes only the lock itself.
+     */
+    struct NoShardStats {
+        void locked(bool, bool) {}
+
+        void snapshot(ShardStats &out) const {
+            out.reads = out.writes = out.contended = 0;
+        }
+    };
+
+    /*! Hash map that any number of threads can use at once.
+     *
+     * Entries are spread over a power-of-two number of shards, each a
+     * `FlatDict` behind its own `thr::SharedSpinLock`, so threads only
+     * contend when they touch the same shard, and readers of a shard don't
+     * block each other. Shards are padded so that no two of them share a
+     * cache line. Use `stats()` to check that keys are spread evenly, and
+     * pass `ShardStatsRecorder` as `StatsT` to also count locks and spot hot
+     * shards.
+     *
+     * Reads of one shard don't scale with threads, even though they don't
+     * block each other: each read still takes and releases the shard's
+     * lock, two atomic writes to one cache line that then bounces between
+     * the readers' cores. Spread hot keys out, or give threads that
+     * mostly read the same few keys their own copies.
+     *
+     * Values are returned by copy, since a reference would outlive the
+     * shard's lock, so keep `ValType` cheap to copy (e.g. wrap big values in
+     * a `shared_ptr`).
+     *
+     * Suggested usage:
+     *
+     *      dict::ConcurrentDict<unsigned, Region> regions;
+     *      dict::ConcurrentDict<unsigned, unsigned> hits;
+     *
+     *      // any worker thread
+     *      Region r = regions.getOrCompute(color, [&](unsigned c) {
+     *          return findRegion(frame, c);
+     *      });
+     *      hits.upsert(color, [](unsigned &n) { n++; });
+     */
+    template <typename KeyType, typename ValType, typename HashT=hash<KeyType>, typename EqualT=equal_to<KeyType>,
+              typename StatsT=NoShardStats>
+    class ConcurrentDict {
+    public:
+        typedef KeyType key_type;
+        typedef ValType mapped_type;
+        typedef pair<KeyType, ValType> value_type;
+        typedef size_t size_type;
+
+    private:
+        typedef thr::SharedSpinLock LockT;
+
+        struct Shard : StatsT {
+            LockT lock;
+            FlatDict<KeyType, ValType, HashT, EqualT> items;
+            char _pad[thr::CACHE_LINE_SIZE];
+        };
+
+        unique_ptr<Shard[]> shards;
+        size_t mask;
+
+    public:
+        /*! @throws invalid_argument
+         * Thrown if `nShards` is not a power of two.
+         */
+        explicit ConcurrentDict(size_t nShards=64) : shards(new Shard[nShards]), mask(nShards - 1) {
+            if (nShards == 0 or (nShards & this->mask) != 0) {
+                throw invalid_argument("`nShards` must be a power of two");
+            }
+        }
+
+        ConcurrentDict(const ConcurrentDict &) = delete;
+        ConcurrentDict &operator=(const ConcurrentDict &) = delete;
+
+        size_t nShards() const {
+            return this->mask + 1;
+        }
+
+        /*! If `key` is there, copy its value to `out` and return `true`. */
+        bool get(const KeyType &key, ValType &out) const {
+            Shard &shard = this->shardOf(key);
+            this->lockShared(shard);
+            thr::SharedLockGuard<LockT> guard(shard.lock, adopt_lock);
+            auto it = shard.items.find(key);
+            if (it == shard.items.end()) {
+                return false;
+            }
+            out = it->second;
+            return true;
+        }
+
+        bool contains(const KeyType &key) const {
+            Shard &shard = this->shardOf(key);
+            this->lockShared(shard);
+            thr::SharedLockGuard<LockT> guard(shard.lock, adopt_lock);
+            return shard.items.count(key) != 0;
+        }
+
+        /*! Insert `key` with `val` unless `key` is already there. Return
+         * whether it was inserted.
+         */
+        bool insert(const KeyType &key, const ValType &val) {
+            Shard &shard = this->shardOf(key);
+            this->lock(shard);
+            lock_guard<LockT> guard(shard.lock, adopt_lock);
+            return shard.items.insert(value_type(key, val)).second;
+        }
+
+        /*! Set the value of `key` to `val`, inserting it if needed. */
+        void upsert(const KeyType &key, const ValType &val) {
+            Shard &shard = this->shardOf(key);
+            this->lock(shard);
+            lock_guard<LockT> guard(shard.lock, adopt_lock);
+            shard.items[key] = val;
+        }
+
+        /*! Call `update(ValType &)` on the value of `key`, which is first
+         * inserted as `ValType()` if it isn't there. `update` runs under the
+         * shard's lock, so it should be quick and must not use this dict.
+         */
+        template <typename UpdateT>
+        typename enable_if<not is_convertible<UpdateT, ValType>::value>::type
+        upsert(const KeyType &key, UpdateT update) {
+            Shard &shard = this->shardOf(key);
+            this->lock(shard);
+            lock_guard<LockT> guard(shard.lock, adopt_lock);
+            update(shard.items[key]);
+        }
+
+        /*! Return the value of `key`, first inserting `compute(key)` if it
+         * isn't there.
+         *
+         * `compute` runs without holding any lock, so slow computations don't
+         * stall other threads, but threads missing on the same key at once
+         * may each call it. Only the first result is stored, and all of them
+         * get that one back.
+         */
+        template <typename ComputeT>
+        ValType getOrCompute(const KeyType &key, ComputeT compute) {
+            ValType val;
+            if (this->get(key, val)) {
+                return val;
+            }
+            val = compute(key);
+
+            Shard &shard = this->shardOf(key);
+            this->lock(shard);
+            lock_guard<LockT> guard(shard.lock, adopt_lock);
+            return shard.items.insert(value_type(key, move(val))).first->second;
+        }
+
+        /*! Remove `key` if it's there, and return the number of entries
+         * removed.
+         */
+        size_t erase(const KeyType &key) {
+            Shard &shard = this->shardOf(key);
+            this->lock(shard);
+            lock_guard<LockT> guard(shard.lock, adopt_lock);
+            return shard.items.erase(key);
+        }
+
+        /*! Return the number of entries. Shards are counted one at a time, so
+         * with concurrent writers this is only a rough figure.
+         */
+        size_t size() const {
+            size_t n = 0;
+            for (size_t i = 0; i <= this->mask; i++) {
+                thr::SharedLockGuard<LockT> guard(this->shards[i].lock);
+                n += this->shards[i].items.size();
+            }
+            return n;
+        }
+
+        void clear() {
+            for (size_t i = 0; i <= this->mask; i++) {
+                lock_guard<LockT> guard(this->shards[i].lock);
+                this->shards[i].items.clear();
+            }
+        }
+
+        /*! Call `func(const KeyType &, const ValType &)` on every entry, one
+         * shard at a time under its read lock. `func` must not touch this dict
+         * at all: writes deadlock, and so do reads once a writer is waiting on
+         * the shard, since waiting writers lock out new readers.
+         */
+        template <typename FuncT>
+        void forEach(FuncT func) const {
+            for (size_t i = 0; i <= this->mask; i++) {
+                thr::SharedLockGuard<LockT> guard(this->shards[i].lock);
+                for (const value_type &item : this->shards[i].items) {
+                    func(item.first, item.second);
+                }
+            }
+        }
+
+        /*! Return a snapshot of each shard's counters, in shard order. */
+        vector<ShardStats> stats() const {
+            vector<ShardStats> res(this->mask + 1);
+            for (size_t i = 0; i <= this->mask; i++) {
+                Shard &shard = this->shards[i];
+                {
+                    thr::SharedLockGuard<LockT> guard(shard.lock);
+                    res[i].size = shard.items.size();
+                }
+                shard.snapshot(res[i]);
+            }
+            return res;
+        }
+
+    private:
+        /*! Pick the shard from different bits of the hash than the ones
+         * `FlatDict` uses for slots, so each shard's table still fills
+         * evenly.
+         */
+        Shard &shardOf(const KeyType &key) const {
+            uint64_t h = uint64_t(HashT()(key));
+            h ^= h >> 33;
+            h *= 0xFF51AFD7ED558CCDULL;
+            h ^= h >> 33;
+            return this->shards[size_t(h) & this->mask];
+        }
+
+        void lockShared(Shard &shard) const {
+            bool waited = not shard.lock.try_lock_shared();
+            if (waited) {
+                shard.lock.lock_shared();
+            }
+            shard.locked(false, waited);
+        }
+
+        void lock(Shard &shard) {
+            bool waited = not shard.lock.try_lock();
+            if (waited) {
+                shard.lock.lock();
+            }
+            shard.locked(true, waited);
+        }
+    };
+
+    /*! `countBytes`, with chunks counted in parallel per `policy` and the
+     * partial histograms then summed.
+     */
+    inline void countBytes(const seq::execution::Policy &policy, const uint8_t *data, size_t n, unsigned *counts) {
+        size_t chunkSize = policy.chunkSize(n);
+        size_t nChunks = (n + chunkSize - 1) / chunkSize;
+        vector<array<unsigned, 256>> partial(nChunks);
+        seq::execution::_forChunks(policy, n, chunkSize, [&](size_t chunk, size_t lo, size_t hi) {
+            partial[chunk].fill(0);
+            countBytes(data + lo, hi - lo, partial[chunk].data());
+        });
+        for (auto &p : partial) {
+            for (size_t b = 0; b < 256; b++) {
+                counts[b] += p[b];
+            }
+        }
+    }
+
+    template <typename IterT, typename DictT>
+    void _countElemsPar(const seq::execution::Policy &policy, const IterT &start, size_t n, size_t chunkSize,
+                        DictT &out, false_type /* dense */) {
+        size_t nChunks = (n + chunkSize - 1) / chunkSize;
+        vector<DictT> partial(nChunks);
+        seq::execution::_forChunks(policy, n, chunkSize, [&](size_t chunk, size_t lo, size_t hi) {
+            _countElems(start + ptrdiff_t(lo), start + ptrdiff_t(hi), partial[chunk], false_type());
+        });
+        out = move(partial[0]);
+        for (size_t chunk = 1; chunk < nChunks; chunk++) {
+            for (const auto &kv : partial[chunk]) {
+                out[kv.first] += kv.second;
+            }
+        }
+    }
+
+    template <typename IterT, typename DictT>
+    void _countElemsPar(const seq::execution::Policy &policy, const IterT &start, size_t n, size_t chunkSize,
+                        DictT &out, true_type /* dense */) {
+        typedef typename iterator_traits<IterT>::value_type KeyT;
+        if (not _denseWorthIt<KeyT>(n)) {
+            _countElemsPar(policy, start, n, chunkSize, out, false_type());
+            return;
+        }
+        // keep each chunk long enough to pay for its own array, and add it
+        // into the total as soon as it's done so only one array per worker
+        // is alive at once
+        chunkSize = max(chunkSize, _denseRange<KeyT>() / 8);
+        vector<unsigned> total(_denseRange<KeyT>());
+        mutex totalLock;
+        seq::execution::_forChunks(policy, n, chunkSize, [&](size_t, size_t lo, size_t hi) {
+            vector<unsigned> counts(total.size());
+            _countDense(start + ptrdiff_t(lo), start + ptrdiff_t(hi), counts);
+            lock_guard<mutex> lk(totalLock);
+            for (size_t i = 0; i < total.size(); i++) {
+                total[i] += counts[i];
+            }
+        });
+        _denseToDict<KeyT>(total, out);
+    }
+
+    /*! `countElems` for random-access iterators, with chunks counted into
+     * separate histograms in parallel per `policy`, then merged.
+     */
+    template <typename IterT, typename DictT>
+    DictT &countElems(const seq::execution::Policy &policy, const IterT &start, const IterT &end, DictT &out) {
+        typedef typename iterator_traits<IterT>::value_type KeyT;
+        size_t n = size_t(end - start);
+        size_t chunkSize = policy.chunkSize(n);
+        if (chunkSize >= n) {
+            return countElems(start, end, out);
+        }
+        out.clear();
+        _countElemsPar(policy, start, n, chunkSize, out, _IsDenseKey<KeyT>());
+        return out;
+    }
+}
@@ -49,6 +49,11 @@ void cvutils::VideoReader::operator>>(cv::Mat &im) {
     }
 }
 
+void cvutils::VideoReader::operator>>(thr::Mailbox<cv::Mat> &box) {
+    *this >> box.writeSlot();
+    box.publish();
+}
+
 void cvutils::waitForKeypress() {
     while (waitKey(30) < 0);
 }
@@ -35,6 +35,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "krandom.hpp"
 #include "kmath.hpp"
 #include "seq.hpp"
+#include "thr.hpp"
 #include "ctti.hpp"
 
 using namespace std;
@@ -99,6 +100,11 @@ struct VideoReader
 
     /*! Read next frame from input. */
     void operator>>(cv::Mat &im);
+
+    /*! Read next frame from input straight into `box`'s write buffer and
+     * publish it, dropping the previous frame if it was never picked up.
+     */
+    void operator>>(thr::Mailbox<cv::Mat> &box);
 };
 
 /*! Block until a key is pressed. Focus must be in an OpenCV window. */
@@ -170,6 +176,39 @@ void applyBinaryOp(
     applyBinaryOp(func, temp1, temp2);
 }
 
+/*! Parallel version of applyBinaryOp(): rows are split into chunks and run
+ * on `pool`, so `func` must be safe to call from several threads at once.
+ *
+ * `m1` and `m2` are taken as headers, so either may be const in the caller.
+ *
+ * @throws runtime_error
+ * Thrown if matrices are not the same size.
+ */
+template <typename T1, typename T2, typename _FuncT>
+void parallelApplyBinaryOp(
+        const _FuncT &func,
+        cv::Mat_<T1> m1,
+        cv::Mat_<T2> m2,
+        thr::ThreadPool &pool=thr::defaultPool()
+        ) {
+    int cols = m1.cols, rows = m1.rows;
+
+    if (cols != m2.cols or rows != m2.rows) {
+        throw runtime_error("matrices must be the same size");
+    }
+
+    // a few chunks per worker so stealing can even out the load
+    size_t grain = max(size_t(rows) / (4 * pool.size()), size_t(1));
+    pool.parallelFor(0, size_t(rows), grain, [&](size_t row) {
+        int i = int(row);
+        auto *i1 = m1[i];
+        auto *i2 = m2[i];
+        for (int j = 0; j < cols; j++) {
+            func(i, j, i1 + j, i2 + j);
+        }
+    });
+}
+
 /*! Return a random RGB color. */
 inline cv::Scalar randColor() {
     return cv::Scalar(
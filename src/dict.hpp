@@ -26,9 +26,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include "io.hpp"
 
 using namespace std;
 
@@ -38,13 +50,766 @@ namespace dict {
     template <typename KeyType, typename ValType>
     using Dict = unordered_map<KeyType, ValType>;
 
-    template <typename KeyType, typename ValType>
-    void _makeDictIP(Dict<KeyType, ValType> &d, KeyType key, ValType val) {
+    /*! Print `d` as `{item, item, ...}`. */
+    template <typename DictT>
+    ostream &_printDict(ostream &out, const DictT &d) {
+        if (d.empty()) {
+            out << "{}";
+            return out;
+        }
+
+        out << "{";
+        auto it = d.begin();
+        while (1) {
+            auto newIt = it;
+            newIt++;
+            if (newIt == d.end()) {
+                break;
+            }
+            out << *it << ", ";
+
+            it = newIt;
+        }
+        out << *it << "}";
+
+        return out;
+    }
+
+    /*! Hash map with open addressing and Robin Hood probing, for when
+     * `Dict`'s per-entry allocations and pointer chasing show up in
+     * profiles. All entries live in one array, next to a byte per slot
+     * holding the entry's probe distance. For keys other than numbers, the
+     * hashes are kept as well, so growing doesn't rehash keys and most
+     * mismatching keys are never compared.
+     *
+     * Mostly a drop-in for `Dict`, except that:
+     * - Elements are `pair<KeyType, ValType>`; don't change keys through
+     *   iterators or references.
+     * - Inserting or erasing invalidates all iterators and references, as
+     *   entries move around.
+     */
+    template <typename KeyType, typename ValType, typename HashT=hash<KeyType>, typename EqualT=equal_to<KeyType>>
+    class FlatDict {
+    public:
+        typedef KeyType key_type;
+        typedef ValType mapped_type;
+        typedef pair<KeyType, ValType> value_type;
+        typedef value_type &reference;
+        typedef const value_type &const_reference;
+        typedef size_t size_type;
+
+        template <bool IS_CONST>
+        class Iterator {
+        public:
+            typedef forward_iterator_tag iterator_category;
+            typedef typename FlatDict::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef typename conditional<IS_CONST, const value_type *, value_type *>::type pointer;
+            typedef typename conditional<IS_CONST, const value_type &, value_type &>::type reference;
+            typedef typename conditional<IS_CONST, const FlatDict *, FlatDict *>::type DictPtr;
+
+            Iterator(DictPtr d, size_t i) : d(d), i(i) {}
+            // iterator -> const_iterator
+            Iterator(const Iterator<false> &other) : d(other.d), i(other.i) {}
+
+            reference operator*() const { return this->d->slots[this->i]; }
+            pointer operator->() const { return &this->d->slots[this->i]; }
+
+            Iterator &operator++() {
+                this->i = this->d->nextUsed(this->i + 1);
+                return *this;
+            }
+            Iterator operator++(int) {
+                Iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const Iterator &other) const { return this->i == other.i; }
+            bool operator!=(const Iterator &other) const { return this->i != other.i; }
+
+        private:
+            friend class FlatDict;
+            friend class Iterator<not IS_CONST>;
+
+            DictPtr d;
+            size_t i;
+        };
+        typedef Iterator<false> iterator;
+        typedef Iterator<true> const_iterator;
+
+        FlatDict() : slots(NULL), dists(NULL), hashes(NULL), nSlots(0), n(0), shift(64) {}
+
+        FlatDict(initializer_list<value_type> items) : FlatDict() {
+            this->reserve(items.size());
+            for (const value_type &item : items) {
+                this->insert(item);
+            }
+        }
+
+        FlatDict(const FlatDict &other) : FlatDict() {
+            this->reserve(other.n);
+            for (const value_type &item : other) {
+                this->insert(item);
+            }
+        }
+
+        FlatDict(FlatDict &&other) : FlatDict() {
+            this->swap(other);
+        }
+
+        ~FlatDict() {
+            this->clear();
+            ::operator delete(this->slots);
+            delete[] this->dists;
+            delete[] this->hashes;
+        }
+
+        FlatDict &operator=(FlatDict other) {
+            this->swap(other);
+            return *this;
+        }
+
+        void swap(FlatDict &other) {
+            std::swap(this->slots, other.slots);
+            std::swap(this->dists, other.dists);
+            std::swap(this->hashes, other.hashes);
+            std::swap(this->nSlots, other.nSlots);
+            std::swap(this->n, other.n);
+            std::swap(this->shift, other.shift);
+        }
+
+        iterator begin() { return iterator(this, this->nextUsed(0)); }
+        iterator end() { return iterator(this, this->nSlots); }
+        const_iterator begin() const { return const_iterator(this, this->nextUsed(0)); }
+        const_iterator end() const { return const_iterator(this, this->nSlots); }
+
+        size_t size() const { return this->n; }
+        bool empty() const { return this->n == 0; }
+
+        iterator find(const KeyType &key) {
+            return iterator(this, this->lookup(key, this->hashOf(key)));
+        }
+        const_iterator find(const KeyType &key) const {
+            return const_iterator(this, this->lookup(key, this->hashOf(key)));
+        }
+
+        size_t count(const KeyType &key) const {
+            return this->lookup(key, this->hashOf(key)) == this->nSlots ? 0 : 1;
+        }
+
+        /*! Throw `out_of_range` if `key` isn't in the dict. */
+        ValType &at(const KeyType &key) {
+            size_t i = this->lookup(key, this->hashOf(key));
+            if (i == this->nSlots) {
+                throw out_of_range("key not in FlatDict");
+            }
+            return this->slots[i].second;
+        }
+        const ValType &at(const KeyType &key) const {
+            return const_cast<FlatDict *>(this)->at(key);
+        }
+
+        ValType &operator[](const KeyType &key) {
+            uint64_t h = this->hashOf(key);
+            size_t i = this->lookup(key, h);
+            if (i == this->nSlots) {
+                i = this->insertNew(value_type(key, ValType()), h);
+            }
+            return this->slots[i].second;
+        }
+
+        /*! Insert `item` unless its key is already there. Return an iterator
+         * to the entry with the key, and whether `item` was inserted.
+         */
+        pair<iterator, bool> insert(const value_type &item) {
+            uint64_t h = this->hashOf(item.first);
+            size_t i = this->lookup(item.first, h);
+            if (i != this->nSlots) {
+                return make_pair(iterator(this, i), false);
+            }
+            return make_pair(iterator(this, this->insertNew(value_type(item), h)), true);
+        }
+
+        template <typename... ArgsT>
+        pair<iterator, bool> emplace(ArgsT &&... args) {
+            value_type item(forward<ArgsT>(args)...);
+            uint64_t h = this->hashOf(item.first);
+            size_t i = this->lookup(item.first, h);
+            if (i != this->nSlots) {
+                return make_pair(iterator(this, i), false);
+            }
+            return make_pair(iterator(this, this->insertNew(move(item), h)), true);
+        }
+
+        /*! Remove `key` if it's there, and return the number of entries
+         * removed.
+         */
+        size_t erase(const KeyType &key) {
+            size_t i = this->lookup(key, this->hashOf(key));
+            if (i == this->nSlots) {
+                return 0;
+            }
+            // shift the following entries of the probe run back by one
+            size_t mask = this->nSlots - 1;
+            size_t next = (i + 1) & mask;
+            while (this->dists[next] > 1) {
+                this->slots[i] = move(this->slots[next]);
+                this->dists[i] = uint8_t(this->dists[next] - 1);
+                if (CACHE_HASHES) {
+                    this->hashes[i] = this->hashes[next];
+                }
+                i = next;
+                next = (i + 1) & mask;
+            }
+            this->slots[i].~value_type();
+            this->dists[i] = 0;
+            this->n--;
+            return 1;
+        }
+
+        void clear() {
+            for (size_t i = 0; i < this->nSlots; i++) {
+                if (this->dists[i] != 0) {
+                    this->slots[i].~value_type();
+                    this->dists[i] = 0;
+                }
+            }
+            this->n = 0;
+        }
+
+        /*! Make room for `count` entries without rehashing. */
+        void reserve(size_t count) {
+            size_t wanted = MIN_SLOTS;
+            while (wanted * MAX_LOAD_NUM < count * MAX_LOAD_DEN) {
+                wanted *= 2;
+            }
+            if (wanted > this->nSlots) {
+                this->rehash(wanted);
+            }
+        }
+
+        /*! Return the number of slots. */
+        size_t bucket_count() const {
+            return this->nSlots;
+        }
+
+        /*! Return the home slot of `key`, where probing for it starts. */
+        size_t bucket(const KeyType &key) const {
+            return this->nSlots == 0 ? 0 : size_t(this->hashOf(key) >> this->shift);
+        }
+
+        friend bool operator==(const FlatDict &a, const FlatDict &b) {
+            if (a.n != b.n) {
+                return false;
+            }
+            for (const value_type &item : a) {
+                auto it = b.find(item.first);
+                if (it == b.end() or not (it->second == item.second)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        friend bool operator!=(const FlatDict &a, const FlatDict &b) {
+            return not (a == b);
+        }
+
+        friend ostream &operator<<(ostream &out, const FlatDict &d) {
+            return _printDict(out, d);
+        }
+
+    private:
+        static const size_t MIN_SLOTS = 8;
+        // grow past 3/4 full
+        static const size_t MAX_LOAD_NUM = 3;
+        static const size_t MAX_LOAD_DEN = 4;
+        // probe distances are stored + 1 in a byte, with 0 for empty slots
+        static const uint8_t MAX_DIST = 255;
+
+        static const bool CACHE_HASHES = not is_arithmetic<KeyType>::value;
+
+        value_type *slots;
+        uint8_t *dists;
+        // mixed hash of each entry, if `CACHE_HASHES`
+        uint64_t *hashes;
+        size_t nSlots;
+        size_t n;
+        // 64 - log2(`nSlots`)
+        unsigned shift;
+
+        /*! Hash of `key`. `std::hash` is often the identity, so mix it with a
+         * Fibonacci multiply; the home slot is then the top bits.
+         */
+        uint64_t hashOf(const KeyType &key) const {
+            return uint64_t(HashT()(key)) * 0x9E3779B97F4A7C15ULL;
+        }
+
+        /*! Return the slot of `key`, with hash `h`, or `nSlots` if it isn't
+         * there.
+         */
+        size_t lookup(const KeyType &key, uint64_t h) const {
+            if (this->n == 0) {
+                return this->nSlots;
+            }
+            size_t mask = this->nSlots - 1;
+            size_t i = size_t(h >> this->shift);
+            // an entry closer to its home than we are to ours would have
+            // been displaced by `key`, so `key` can't be further along
+            for (unsigned dist = 1; this->dists[i] >= dist; dist++) {
+                if ((not CACHE_HASHES or this->hashes[i] == h) and EqualT()(this->slots[i].first, key)) {
+                    return i;
+                }
+                i = (i + 1) & mask;
+            }
+            return this->nSlots;
+        }
+
+        /*! Insert `item`, with hash `h`, whose key must not be in the dict yet,
+         * and return its slot.
+         */
+        size_t insertNew(value_type &&item, uint64_t h) {
+            if ((this->n + 1) * MAX_LOAD_DEN > this->nSlots * MAX_LOAD_NUM) {
+                this->rehash(max(this->nSlots * 2, size_t(MIN_SLOTS)));
+            }
+
+            size_t mask = this->nSlots - 1;
+            size_t i = size_t(h >> this->shift);
+            size_t placedAt = this->nSlots;
+            uint8_t dist = 1;
+            while (true) {
+                if (this->dists[i] == 0) {
+                    new (this->slots + i) value_type(move(item));
+                    this->dists[i] = dist;
+                    if (CACHE_HASHES) {
+                        this->hashes[i] = h;
+                    }
+                    break;
+                }
+                if (this->dists[i] < dist) {
+                    // take from the rich: the resident is closer to home
+                    std::swap(item, this->slots[i]);
+                    std::swap(dist, this->dists[i]);
+                    // keep `h` the hash of the entry in hand
+                    if (CACHE_HASHES) {
+                        std::swap(h, this->hashes[i]);
+                    } else {
+                        h = this->hashOf(item.first);
+                    }
+                    if (placedAt == this->nSlots) {
+                        placedAt = i;
+                    }
+                }
+                i = (i + 1) & mask;
+                if (++dist == MAX_DIST) {
+                    // pathologically long probe run: grow and start over
+                    // with the entry still in hand
+                    KeyType key = placedAt == this->nSlots ? item.first : this->slots[placedAt].first;
+                    this->rehash(this->nSlots * 2);
+                    this->insertNew(move(item), h);
+                    return this->lookup(key, this->hashOf(key));
+                }
+            }
+            this->n++;
+            return placedAt == this->nSlots ? i : placedAt;
+        }
+
+        void rehash(size_t newNSlots) {
+            value_type *oldSlots = this->slots;
+            uint8_t *oldDists = this->dists;
+            uint64_t *oldHashes = this->hashes;
+            size_t oldNSlots = this->nSlots;
+
+            this->slots = static_cast<value_type *>(::operator new(newNSlots * sizeof(value_type)));
+            this->dists = new uint8_t[newNSlots]();
+            this->hashes = CACHE_HASHES ? new uint64_t[newNSlots] : NULL;
+            this->nSlots = newNSlots;
+            this->n = 0;
+            this->shift = 64;
+            for (size_t s = newNSlots; s > 1; s /= 2) {
+                this->shift--;
+            }
+
+            for (size_t i = 0; i < oldNSlots; i++) {
+                if (oldDists[i] != 0) {
+                    uint64_t h = CACHE_HASHES ? oldHashes[i] : this->hashOf(oldSlots[i].first);
+                    this->insertNew(move(oldSlots[i]), h);
+                    oldSlots[i].~value_type();
+                }
+            }
+            ::operator delete(oldSlots);
+            delete[] oldDists;
+            delete[] oldHashes;
+        }
+
+        size_t nextUsed(size_t i) const {
+            while (i < this->nSlots and this->dists[i] == 0) {
+                i++;
+            }
+            return i;
+        }
+    };
+
+    /*! Snapshot of a cache's counters. */
+    struct CacheStats {
+        unsigned long hits;
+        unsigned long misses;
+        /*! Number of entries dropped to make room for new ones. */
+        unsigned long evictions;
+
+        /*! Return the fraction of lookups that were hits, or 0 if there were
+         * none.
+         */
+        float hitRate() const {
+            unsigned long n = this->hits + this->misses;
+            return n == 0 ? 0 : float(this->hits) / float(n);
+        }
+    };
+
+    /*! Map holding at most `capacity()` entries, dropping the least recently
+     * used one to make room for a new one.
+     *
+     * Entries live in an array allocated up front, linked in order of use,
+     * with a `FlatDict` from key to array index, so lookups and insertions
+     * are O(1) and never allocate once the cache is full (unless the keys or
+     * values do). Not thread-safe.
+     *
+     * Pointers and references to values stay valid until their entry is
+     * evicted or the cache is cleared.
+     */
+    template <typename KeyType, typename ValType, typename HashT=hash<KeyType>, typename EqualT=equal_to<KeyType>>
+    class LRUCache {
+    public:
+        typedef KeyType key_type;
+        typedef ValType mapped_type;
+        typedef pair<KeyType, ValType> value_type;
+
+    private:
+        static const size_t NONE = SIZE_MAX;
+
+        struct Node {
+            value_type item;
+            size_t prev;
+            size_t next;
+
+            Node(value_type &&item) : item(move(item)), prev(NONE), next(NONE) {}
+        };
+
+        size_t cap;
+        vector<Node> nodes;
+        FlatDict<KeyType, size_t, HashT, EqualT> index;
+        /*! Most and least recently used nodes. */
+        size_t head, tail;
+        CacheStats _stats;
+
+    public:
+        /*! @throws invalid_argument
+         * Thrown if `capacity` is 0.
+         */
+        explicit LRUCache(size_t capacity) : cap(capacity), head(NONE), tail(NONE), _stats() {
+            if (capacity == 0) {
+                throw invalid_argument("`capacity` must be positive");
+            }
+            this->nodes.reserve(capacity);
+            this->index.reserve(capacity);
+        }
+
+        size_t capacity() const { return this->cap; }
+        size_t size() const { return this->nodes.size(); }
+
+        /*! Return whether `key` is cached, without counting a lookup or
+         * marking it as used.
+         */
+        bool contains(const KeyType &key) const {
+            return this->index.count(key) != 0;
+        }
+
+        /*! Return a pointer to the value of `key` and mark it as most recently
+         * used, or `NULL` if it isn't cached.
+         */
+        ValType *find(const KeyType &key) {
+            auto it = this->index.find(key);
+            if (it == this->index.end()) {
+                this->_stats.misses++;
+                return NULL;
+            }
+            this->_stats.hits++;
+            this->touch(it->second);
+            return &this->nodes[it->second].item.second;
+        }
+
+        /*! If `key` is cached, copy its value to `out` and return `true`. */
+        bool get(const KeyType &key, ValType &out) {
+            ValType *val = this->find(key);
+            if (val == NULL) {
+                return false;
+            }
+            out = *val;
+            return true;
+        }
+
+        /*! Set the value of `key`, evicting the least recently used entry if
+         * the cache is full.
+         */
+        void put(const KeyType &key, ValType val) {
+            auto it = this->index.find(key);
+            if (it != this->index.end()) {
+                this->nodes[it->second].item.second = move(val);
+                this->touch(it->second);
+            } else {
+                this->insertNew(key, move(val));
+            }
+        }
+
+        /*! Return the value of `key`, computing it with `compute(key)` and
+         * caching it on a miss.
+         */
+        template <typename ComputeT>
+        ValType &getOrCompute(const KeyType &key, ComputeT compute) {
+            ValType *val = this->find(key);
+            if (val != NULL) {
+                return *val;
+            }
+            return this->nodes[this->insertNew(key, compute(key))].item.second;
+        }
+
+        void clear() {
+            this->nodes.clear();
+            this->index.clear();
+            this->head = this->tail = NONE;
+        }
+
+        CacheStats stats() const { return this->_stats; }
+        void resetStats() { this->_stats = CacheStats(); }
+
+    private:
+        /*! Add `key`, which must not be cached yet, and return its node. */
+        size_t insertNew(const KeyType &key, ValType &&val) {
+            size_t i;
+            if (this->nodes.size() < this->cap) {
+                i = this->nodes.size();
+                this->nodes.push_back(Node(value_type(key, move(val))));
+            } else {
+                i = this->tail;
+                this->unlink(i);
+                this->index.erase(this->nodes[i].item.first);
+                this->nodes[i].item = value_type(key, move(val));
+                this->_stats.evictions++;
+            }
+            this->index.insert(make_pair(key, i));
+            this->pushFront(i);
+            return i;
+        }
+
+        void touch(size_t i) {
+            if (i != this->head) {
+                this->unlink(i);
+                this->pushFront(i);
+            }
+        }
+
+        void unlink(size_t i) {
+            Node &node = this->nodes[i];
+            if (node.prev == NONE) {
+                this->head = node.next;
+            } else {
+                this->nodes[node.prev].next = node.next;
+            }
+            if (node.next == NONE) {
+                this->tail = node.prev;
+            } else {
+                this->nodes[node.next].prev = node.prev;
+            }
+        }
+
+        void pushFront(size_t i) {
+            Node &node = this->nodes[i];
+            node.prev = NONE;
+            node.next = this->head;
+            if (this->head == NONE) {
+                this->tail = i;
+            } else {
+                this->nodes[this->head].prev = i;
+            }
+            this->head = i;
+        }
+    };
+
+    /*! Cache with the interface of `LRUCache` that approximates LRU with the
+     * CLOCK algorithm: a hit only sets the entry's "referenced" flag, and
+     * eviction sweeps a hand around the entries, clearing flags, until it
+     * finds one that wasn't used since the last sweep.
+     *
+     * Hits don't relink anything, so they're cheaper than `LRUCache`'s and
+     * only write one byte, at the cost of sometimes evicting a less
+     * recently used entry than the oldest. Not thread-safe.
+     */
+    template <typename KeyType, typename ValType, typename HashT=hash<KeyType>, typename EqualT=equal_to<KeyType>>
+    class ClockCache {
+    public:
+        typedef KeyType key_type;
+        typedef ValType mapped_type;
+        typedef pair<KeyType, ValType> value_type;
+
+    private:
+        size_t cap;
+        vector<value_type> items;
+        vector<uint8_t> referenced;
+        FlatDict<KeyType, size_t, HashT, EqualT> index;
+        size_t hand;
+        CacheStats _stats;
+
+    public:
+        /*! @throws invalid_argument
+         * Thrown if `capacity` is 0.
+         */
+        explicit ClockCache(size_t capacity) : cap(capacity), hand(0), _stats() {
+            if (capacity == 0) {
+                throw invalid_argument("`capacity` must be positive");
+            }
+            this->items.reserve(capacity);
+            this->referenced.reserve(capacity);
+            this->index.reserve(capacity);
+        }
+
+        size_t capacity() const { return this->cap; }
+        size_t size() const { return this->items.size(); }
+
+        /*! See `LRUCache::contains()`. */
+        bool contains(const KeyType &key) const {
+            return this->index.count(key) != 0;
+        }
+
+        /*! See `LRUCache::find()`. */
+        ValType *find(const KeyType &key) {
+            auto it = this->index.find(key);
+            if (it == this->index.end()) {
+                this->_stats.misses++;
+                return NULL;
+            }
+            this->_stats.hits++;
+            this->referenced[it->second] = 1;
+            return &this->items[it->second].second;
+        }
+
+        bool get(const KeyType &key, ValType &out) {
+            ValType *val = this->find(key);
+            if (val == NULL) {
+                return false;
+            }
+            out = *val;
+            return true;
+        }
+
+        void put(const KeyType &key, ValType val) {
+            auto it = this->index.find(key);
+            if (it != this->index.end()) {
+                this->items[it->second].second = move(val);
+                this->referenced[it->second] = 1;
+            } else {
+                this->insertNew(key, move(val));
+            }
+        }
+
+        template <typename ComputeT>
+        ValType &getOrCompute(const KeyType &key, ComputeT compute) {
+            ValType *val = this->find(key);
+            if (val != NULL) {
+                return *val;
+            }
+            return this->items[this->insertNew(key, compute(key))].second;
+        }
+
+        void clear() {
+            this->items.clear();
+            this->referenced.clear();
+            this->index.clear();
+            this->hand = 0;
+        }
+
+        CacheStats stats() const { return this->_stats; }
+        void resetStats() { this->_stats = CacheStats(); }
+
+    private:
+        size_t insertNew(const KeyType &key, ValType &&val) {
+            size_t i;
+            if (this->items.size() < this->cap) {
+                i = this->items.size();
+                this->items.push_back(value_type(key, move(val)));
+                this->referenced.push_back(0);
+            } else {
+                while (this->referenced[this->hand]) {
+                    this->referenced[this->hand] = 0;
+                    this->hand = this->hand + 1 == this->cap ? 0 : this->hand + 1;
+                }
+                i = this->hand;
+                this->hand = this->hand + 1 == this->cap ? 0 : this->hand + 1;
+                this->index.erase(this->items[i].first);
+                this->items[i] = value_type(key, move(val));
+                this->_stats.evictions++;
+            }
+            this->index.insert(make_pair(key, i));
+            return i;
+        }
+    };
+
+    /*! Wraps a one-argument function, caching its results in a `CacheT`
+     * (`LRUCache` or `ClockCache`). Made by `memoize()`. Not thread-safe.
+     */
+    template <typename FuncT, typename CacheT>
+    class Memoized {
+    public:
+        typedef typename CacheT::key_type argument_type;
+        typedef typename CacheT::mapped_type result_type;
+
+    private:
+        FuncT func;
+        CacheT _cache;
+
+    public:
+        Memoized(FuncT func, size_t capacity) : func(move(func)), _cache(capacity) {}
+
+        result_type operator()(const argument_type &arg) {
+            return this->_cache.getOrCompute(arg, ref(this->func));
+        }
+
+        /*! For checking `stats()` or dropping stale results. */
+        CacheT &cache() { return this->_cache; }
+        const CacheT &cache() const { return this->_cache; }
+    };
+
+    /*! Return `func` wrapped so its results for the last `capacity` distinct
+     * arguments used are cached. `ArgT` can't be deduced and must be given.
+     *
+     * Suggested usage:
+     *
+     *      auto predict = dict::memoize<unsigned>([&](unsigned color) {
+     *          return classify(color);
+     *      }, 1 << 16);
+     *      float p = predict(color);
+     */
+    template <typename ArgT, typename FuncT>
+    Memoized<FuncT, LRUCache<ArgT, typename decay<typename result_of<FuncT(const ArgT &)>::type>::type>>
+    memoize(FuncT func, size_t capacity) {
+        typedef typename decay<typename result_of<FuncT(const ArgT &)>::type>::type ResT;
+        return Memoized<FuncT, LRUCache<ArgT, ResT>>(move(func), capacity);
+    }
+
+    /*! `memoize()` with a `ClockCache`. */
+    template <typename ArgT, typename FuncT>
+    Memoized<FuncT, ClockCache<ArgT, typename decay<typename result_of<FuncT(const ArgT &)>::type>::type>>
+    memoizeClock(FuncT func, size_t capacity) {
+        typedef typename decay<typename result_of<FuncT(const ArgT &)>::type>::type ResT;
+        return Memoized<FuncT, ClockCache<ArgT, ResT>>(move(func), capacity);
+    }
+
+    template <typename DictT, typename KeyType, typename ValType>
+    void _makeDictIP(DictT &d, KeyType key, ValType val) {
         d.insert(make_pair(key, val));
     }
 
-    template <typename KeyType, typename ValType, typename... Args>
-    void _makeDictIP(Dict<KeyType, ValType> &d, KeyType key, ValType val, Args... args) {
+    template <typename DictT, typename KeyType, typename ValType, typename... Args>
+    void _makeDictIP(DictT &d, KeyType key, ValType val, Args... args) {
         d.insert(make_pair(key, val));
         _makeDictIP(d, args...);
     }
@@ -66,22 +831,461 @@ namespace dict {
         return d;
     }
 
+    /*! Construct a `FlatDict` with any number of key/value pairs. */
+    template <typename KeyType, typename ValType, typename... Args>
+    FlatDict<KeyType, ValType> makeFlatDict(KeyType key, ValType val, Args... args) {
+        FlatDict<KeyType, ValType> d;
+        _makeDictIP(d, key, val, args...);
+        return d;
+    }
+
+    /*! Compile-time list of indices `0, 1, ..., N-1` (there's no
+     * `index_sequence` in C++11). Built by halves so long lists don't hit the
+     * template recursion limit.
+     */
+    template <size_t... Is>
+    struct _Indices {};
+
+    template <typename A, typename B>
+    struct _ConcatIndices;
+
+    template <size_t... As, size_t... Bs>
+    struct _ConcatIndices<_Indices<As...>, _Indices<Bs...>> {
+        typedef _Indices<As..., (sizeof...(As) + Bs)...> type;
+    };
+
+    template <size_t N>
+    struct _MakeIndices {
+        typedef typename _ConcatIndices<
+            typename _MakeIndices<N / 2>::type,
+            typename _MakeIndices<N - N / 2>::type
+            >::type type;
+    };
+
+    template <>
+    struct _MakeIndices<0> {
+        typedef _Indices<> type;
+    };
+
+    template <>
+    struct _MakeIndices<1> {
+        typedef _Indices<0> type;
+    };
+
+    /*! Plain array wrapper that can be passed around in constant
+     * expressions (`std::array`'s accessors aren't `constexpr` in C++11).
+     */
+    template <typename T, size_t N>
+    struct _CArray {
+        T items[N];
+    };
+
+    /*! 64-bit FNV-1a hash of the NUL-terminated `s`, usable at compile time.
+     */
+    constexpr uint64_t _fnv1aStatic(const char *s, uint64_t h=14695981039346656037ULL) {
+        return *s == '\0' ? h : _fnv1aStatic(s + 1, (h ^ uint8_t(*s)) * 1099511628211ULL);
+    }
+
+    /*! Same hash as `_fnv1aStatic()`, of `s[0..len)`. */
+    inline uint64_t _fnv1a(const char *s, size_t len) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < len; i++) {
+            h = (h ^ uint8_t(s[i])) * 1099511628211ULL;
+        }
+        return h;
+    }
+
+    constexpr uint64_t _xorShift(uint64_t x, unsigned r) {
+        return x ^ (x >> r);
+    }
+
+    /*! MurmurHash3's 64-bit finalizer: spreads the differences between
+     * similar keys (which FNV-1a leaves in the low bits) over all the bits.
+     */
+    constexpr uint64_t _fmix64(uint64_t x) {
+        return _xorShift(_xorShift(_xorShift(x, 33) * 0xFF51AFD7ED558CCDULL, 33) * 0xC4CEB9FE1A85EC53ULL, 33);
+    }
+
+    constexpr size_t _strLen(const char *s) {
+        return *s == '\0' ? 0 : 1 + _strLen(s + 1);
+    }
+
+    constexpr size_t _minC(size_t a, size_t b) {
+        return a < b ? a : b;
+    }
+
+    /*! Number of slots for `n` keys: a power of two of at least `n * n / 4`,
+     * so that about one in seven seeds is a perfect hash.
+     */
+    constexpr size_t _staticSlots(size_t n, size_t slots=2) {
+        return slots >= n and slots * 4 >= n * n ? slots : _staticSlots(n, slots * 2);
+    }
+
+    constexpr unsigned _log2(size_t n) {
+        return n <= 1 ? 0 : 1 + _log2(n / 2);
+    }
+
+    /*! Slot of the key with hash `h` in a table of `2^bits` slots. Different
+     * seeds multiply by different odd numbers and keep the top bits.
+     */
+    constexpr size_t _staticSlot(uint64_t h, uint64_t seed, unsigned bits) {
+        return size_t((h * (2 * seed + 1)) >> (64 - bits));
+    }
+
+    /*! Whether no key in `[a0, a1)` shares a slot with one in `[b0, b1)`.
+     * Ranges are split in halves, so recursion depth stays logarithmic.
+     */
+    constexpr bool _slotsDisjoint(const uint64_t *h, uint64_t seed, unsigned bits,
+            size_t a0, size_t a1, size_t b0, size_t b1) {
+        return a1 - a0 > 1
+            ? _slotsDisjoint(h, seed, bits, a0, (a0 + a1) / 2, b0, b1)
+                and _slotsDisjoint(h, seed, bits, (a0 + a1) / 2, a1, b0, b1)
+            : b1 - b0 > 1
+            ? _slotsDisjoint(h, seed, bits, a0, a1, b0, (b0 + b1) / 2)
+                and _slotsDisjoint(h, seed, bits, a0, a1, (b0 + b1) / 2, b1)
+            : _staticSlot(h[a0], seed, bits) != _staticSlot(h[b0], seed, bits);
+    }
+
+    /*! Whether the keys in `[lo, hi)` all have different slots. */
+    constexpr bool _slotsDistinct(const uint64_t *h, uint64_t seed, unsigned bits, size_t lo, size_t hi) {
+        return hi - lo < 2 or (
+            _slotsDistinct(h, seed, bits, lo, (lo + hi) / 2)
+            and _slotsDistinct(h, seed, bits, (lo + hi) / 2, hi)
+            and _slotsDisjoint(h, seed, bits, lo, (lo + hi) / 2, (lo + hi) / 2, hi)
+            );
+    }
+
+    /*! Whether the hashes in `[lo, hi)` are all different. With 64 bits this
+     * fails only for duplicate keys.
+     */
+    constexpr bool _hashesDistinct(const uint64_t *h, size_t lo, size_t hi) {
+        return _slotsDistinct(h, 0, 64, lo, hi);
+    }
+
+    const uint64_t _NO_SEED = UINT64_MAX;
+
+    constexpr uint64_t _findSeed(const uint64_t *h, size_t n, unsigned bits, uint64_t lo, uint64_t hi);
+
+    constexpr uint64_t _orFindSeed(uint64_t found, const uint64_t *h, size_t n, unsigned bits, uint64_t lo, uint64_t hi) {
+        return found != _NO_SEED ? found : _findSeed(h, n, bits, lo, hi);
+    }
+
+    /*! Return the first seed in `[lo, hi)` that gives the `n` hashes in `h`
+     * different slots, or `_NO_SEED`.
+     */
+    constexpr uint64_t _findSeed(const uint64_t *h, size_t n, unsigned bits, uint64_t lo, uint64_t hi) {
+        return hi - lo == 1
+            ? (_slotsDistinct(h, lo, bits, 0, n) ? lo : _NO_SEED)
+            : _orFindSeed(_findSeed(h, n, bits, lo, (lo + hi) / 2), h, n, bits, (lo + hi) / 2, hi);
+    }
+
+    constexpr uint64_t _seedOrThrow(uint64_t seed) {
+        return seed != _NO_SEED ? seed : throw logic_error("no perfect hash found for StaticDict keys");
+    }
+
+    constexpr uint64_t _perfectSeed(const uint64_t *h, size_t n, unsigned bits) {
+        return _hashesDistinct(h, 0, n)
+            ? _seedOrThrow(_findSeed(h, n, bits, 0, 1 << 12))
+            : throw logic_error("duplicate StaticDict keys");
+    }
+
+    /*! Return the index in `[lo, hi)` of the key whose slot (in
+     * `keySlots`) is `slot`, or `SIZE_MAX` if there isn't one.
+     */
+    constexpr size_t _slotOwner(const size_t *keySlots, size_t slot, size_t lo, size_t hi) {
+        return hi - lo == 1
+            ? (keySlots[lo] == slot ? lo : SIZE_MAX)
+            : _minC(_slotOwner(keySlots, slot, lo, (lo + hi) / 2), _slotOwner(keySlots, slot, (lo + hi) / 2, hi));
+    }
+
+    /*! Key/value pair of a `StaticDict`. */
+    template <typename ValType>
+    struct StaticEntry {
+        const char *key;
+        ValType val;
+    };
+
+    /*! Immutable string-keyed dict whose hash table is built by the compiler,
+     * for fixed tables such as option names to checkers or help strings.
+     *
+     * Construction searches for a seed under which every key gets its own
+     * slot (a perfect hash), so a lookup hashes the key once, checks the
+     * single slot it lands in, and never probes or allocates. When the dict
+     * is declared `constexpr`, all of this happens at compile time and costs
+     * nothing at startup; duplicate keys are then a compile error.
+     *
+     * The table has about `N * N / 4` one-byte slots and takes O(N^3) steps
+     * to build, so this is meant for small tables and takes at most 256
+     * keys; with GCC's default `-fconstexpr-ops-limit`, `constexpr` dicts
+     * stop building somewhere past 128. For `constexpr` dicts,
+     * `ValType` must be a literal type, e.g. a number, a `const char *` or a
+     * function pointer.
+     *
+     * Suggested usage:
+     *
+     *      constexpr dict::StaticEntry<const char *> HELP[] = {
+     *          {"-a", "add some numbers"},
+     *          {"-h", "print a help message"}
+     *      };
+     *      constexpr auto optToHelp = dict::makeStaticDict(HELP);
+     *
+     *      cout << optToHelp.at("-a");
+     */
+    template <typename ValType, size_t N>
+    class StaticDict {
+        static_assert(N > 0 and N <= 256,
+                "StaticDict takes 1 to 256 keys: its table and build time grow as N^2 and N^3; "
+                "use a FlatDict for bigger tables");
+
+    public:
+        typedef const char *key_type;
+        typedef ValType mapped_type;
+        typedef StaticEntry<ValType> value_type;
+        typedef const value_type *const_iterator;
+
+        static constexpr size_t N_SLOTS = _staticSlots(N);
+
+    private:
+        typedef typename conditional<(N < 255), uint8_t, uint16_t>::type IndexT;
+        static constexpr unsigned BITS = _log2(N_SLOTS);
+
+        value_type entries[N];
+        size_t lens[N];
+        uint64_t hashes[N];
+        uint64_t seed;
+        /*! Index of the entry in each slot, or `N` if it's empty. */
+        IndexT slots[N_SLOTS];
+
+        template <size_t... Is>
+        constexpr StaticDict(const value_type (&init)[N], _Indices<Is...> is)
+        : StaticDict(init, is, _CArray<uint64_t, N>{{_fmix64(_fnv1aStatic(init[Is].key))...}}) {}
+
+        template <size_t... Is>
+        constexpr StaticDict(const value_type (&init)[N], _Indices<Is...> is, const _CArray<uint64_t, N> &h)
+        : StaticDict(init, is, h, _perfectSeed(h.items, N, BITS)) {}
+
+        template <size_t... Is>
+        constexpr StaticDict(const value_type (&init)[N], _Indices<Is...> is, const _CArray<uint64_t, N> &h,
+                uint64_t seed)
+        : StaticDict(init, is, h, seed, _CArray<size_t, N>{{_staticSlot(h.items[Is], seed, BITS)...}},
+                typename _MakeIndices<N_SLOTS>::type()) {}
+
+        template <size_t... Is, size_t... Ss>
+        constexpr StaticDict(const value_type (&init)[N], _Indices<Is...>, const _CArray<uint64_t, N> &h,
+                uint64_t seed, const _CArray<size_t, N> &keySlots, _Indices<Ss...>)
+        : entries{init[Is]...}, lens{_strLen(init[Is].key)...}, hashes{h.items[Is]...}, seed(seed),
+        slots{IndexT(_minC(_slotOwner(keySlots.items, Ss, 0, N), N))...} {}
+
+    public:
+        constexpr StaticDict(const value_type (&init)[N])
+        : StaticDict(init, typename _MakeIndices<N>::type()) {}
+
+        constexpr size_t size() const { return N; }
+
+        /*! Entries are in the order they were given. */
+        const_iterator begin() const { return this->entries; }
+        const_iterator end() const { return this->entries + N; }
+
+        /*! Return a pointer to the value of `key[0..len)`, or `NULL` if it
+         * isn't in the dict.
+         */
+        const ValType *find(const char *key, size_t len) const {
+            uint64_t h = _fmix64(_fnv1a(key, len));
+            size_t i = this->slots[_staticSlot(h, this->seed, BITS)];
+            if (i == N or this->hashes[i] != h or this->lens[i] != len
+                    or memcmp(this->entries[i].key, key, len) != 0) {
+                return NULL;
+            }
+            return &this->entries[i].val;
+        }
+        const ValType *find(const char *key) const {
+            return this->find(key, strlen(key));
+        }
+        const ValType *find(const string &key) const {
+            return this->find(key.data(), key.size());
+        }
+
+        size_t count(const string &key) const {
+            return this->find(key) == NULL ? 0 : 1;
+        }
+
+        /*! Throw `out_of_range` if `key` isn't in the dict. */
+        const ValType &at(const string &key) const {
+            const ValType *val = this->find(key);
+            if (val == NULL) {
+                throw out_of_range("key not in StaticDict");
+            }
+            return *val;
+        }
+    };
+
+    template <typename ValType, size_t N>
+    constexpr size_t StaticDict<ValType, N>::N_SLOTS;
+
+    template <typename ValType, size_t N>
+    constexpr unsigned StaticDict<ValType, N>::BITS;
+
+    /*! Construct a `StaticDict` from an array of entries. Declare the result
+     * `constexpr` to build it at compile time.
+     */
+    template <typename ValType, size_t N>
+    constexpr StaticDict<ValType, N> makeStaticDict(const StaticEntry<ValType> (&entries)[N]) {
+        return StaticDict<ValType, N>(entries);
+    }
+
+    /*! Add the number of times each byte value appears in `data[0..n)` to
+     * `counts[0..255]`.
+     *
+     * Counts go to four interleaved sub-histograms, so runs of the same
+     * value (flat image regions) don't serialize on incrementing one
+     * counter.
+     */
+    inline void countBytes(const uint8_t *data, size_t n, unsigned *counts) {
+        unsigned sub[4][256] = {{0}};
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            uint32_t word;
+            memcpy(&word, data + i, 4);
+            sub[0][word & 0xff]++;
+            sub[1][(word >> 8) & 0xff]++;
+            sub[2][(word >> 16) & 0xff]++;
+            sub[3][word >> 24]++;
+        }
+        for (; i < n; i++) {
+            sub[0][data[i]]++;
+        }
+        for (size_t b = 0; b < 256; b++) {
+            counts[b] += sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+        }
+    }
+
+    /*! Whether `countElems` counts `KeyT`s in an array indexed by value:
+     * integers of at most 16 bits.
+     */
+    template <typename KeyT>
+    struct _IsDenseKey : integral_constant<bool,
+        is_integral<KeyT>::value and not is_same<KeyT, bool>::value and sizeof(KeyT) <= 2> {};
+
+    /*! Add the counts of the elements between two iterators to `counts`,
+     * indexed by the elements' values as unsigned integers.
+     */
+    template <typename IterT>
+    void _countDense(IterT start, const IterT &end, vector<unsigned> &counts) {
+        typedef typename iterator_traits<IterT>::value_type KeyT;
+        typedef typename make_unsigned<KeyT>::type U;
+        if (sizeof(KeyT) == 1) {
+            // same interleaving as `countBytes`
+            unsigned sub[4][256] = {{0}};
+            for (size_t j = 0; start != end; ++start, j++) {
+                sub[j & 3][U(*start)]++;
+            }
+            for (size_t b = 0; b < 256; b++) {
+                counts[b] += sub[0][b] + sub[1][b] + sub[2][b] + sub[3][b];
+            }
+        } else {
+            for (; start != end; ++start) {
+                counts[U(*start)]++;
+            }
+        }
+    }
+
+    /*! Number of distinct `KeyT` values, i.e. the size of a dense array. */
+    template <typename KeyT>
+    size_t _denseRange() {
+        return size_t(1) << (8 * sizeof(KeyT));
+    }
+
+    /*! Whether counting `n` `KeyT`s in a dense array beats hashing: always for
+     * bytes, but a 16-bit array is only worth zeroing and scanning when `n` is
+     * at least an eighth of its size.
+     */
+    template <typename KeyT>
+    bool _denseWorthIt(size_t n) {
+        return sizeof(KeyT) == 1 or n >= _denseRange<KeyT>() / 8;
+    }
+
+    template <typename IterT>
+    bool _denseWorthIt(const IterT &start, const IterT &end, random_access_iterator_tag) {
+        return _denseWorthIt<typename iterator_traits<IterT>::value_type>(size_t(end - start));
+    }
+
+    /*! Without random access, the count isn't known up front. */
+    template <typename IterT>
+    bool _denseWorthIt(const IterT &, const IterT &, input_iterator_tag) {
+        return sizeof(typename iterator_traits<IterT>::value_type) == 1;
+    }
+
+    /*! Store the non-zero `counts` from `_countDense` in `out`. */
+    template <typename KeyT, typename DictT>
+    void _denseToDict(const vector<unsigned> &counts, DictT &out) {
+        typedef typename make_unsigned<KeyT>::type U;
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] != 0) {
+                out[KeyT(U(i))] += counts[i];
+            }
+        }
+    }
+
+    template <typename IterT, typename DictT>
+    void _countElems(const IterT &start, const IterT &end, DictT &out, false_type /* dense */) {
+        for (auto it = start; it != end; ++it) {
+            ++out[*it];
+        }
+    }
+
+    template <typename IterT, typename DictT>
+    void _countElems(const IterT &start, const IterT &end, DictT &out, true_type /* dense */) {
+        typedef typename iterator_traits<IterT>::value_type KeyT;
+        if (not _denseWorthIt(start, end, typename iterator_traits<IterT>::iterator_category())) {
+            _countElems(start, end, out, false_type());
+            return;
+        }
+        vector<unsigned> counts(_denseRange<KeyT>());
+        _countDense(start, end, counts);
+        _denseToDict<KeyT>(counts, out);
+    }
+
+    /*! Given a pair of iterators, store a mapping from element to count in
+     * `out` (a `Dict`, `FlatDict` or similar), and return `out`.
+     *
+     * Bytes (e.g. pixel channels), and 16-bit integers when there are enough
+     * of them, are counted in an array rather than in `out` directly.
+     */
+    template <typename IterT, typename DictT>
+    DictT &countElems(const IterT &start, const IterT &end, DictT &out) {
+        typedef typename iterator_traits<IterT>::value_type KeyT;
+        out.clear();
+        _countElems(start, end, out, _IsDenseKey<KeyT>());
+        return out;
+    }
+
     /*! Given a pair of iterators, return a mapping from element to count. */
     template <typename IterT>
-    Dict<typename IterT::value_type, unsigned> countElems(
+    Dict<typename iterator_traits<IterT>::value_type, unsigned> countElems(
             const IterT &start,
             const IterT &end
             ) {
-        Dict<typename IterT::value_type, unsigned> out;
+        Dict<typename iterator_traits<IterT>::value_type, unsigned> out;
+        return countElems(start, end, out);
+    }
 
-        for (auto it = start; it < end; it++) {
-            if (out.count(*it)) {
-                out.at(*it)++;
-            } else {
-                out.insert(pair<typename IterT::value_type, unsigned>(*it, 1));
+    /*! Count the integers between two iterators, all of which must be in
+     * `[low, high)`, into an array: `out[k - low]` is the count of `k`.
+     * Return `out`. Throw `out_of_range` on an element outside the range.
+     */
+    template <typename IterT, typename KeyT>
+    vector<unsigned> &countElemsInRange(const IterT &start, const IterT &end, KeyT low, KeyT high,
+                                        vector<unsigned> &out) {
+        size_t size = high > low ? size_t(high - low) : 0;
+        out.assign(size, 0);
+        for (auto it = start; it != end; ++it) {
+            // elements below `low` wrap around to huge offsets
+            size_t offset = size_t(*it - low);
+            if (offset >= size) {
+                throw out_of_range("element outside [`low`, `high`)");
             }
+            out[offset]++;
         }
-
         return out;
     }
 }
@@ -89,25 +1293,5 @@ namespace dict {
 /*! Print each element of a `Dict`. */
 template <typename KeyT, typename ValT>
 ostream &operator<<(ostream &out, const dict::Dict<KeyT, ValT> &d) {
-    if (d.empty()) {
-        out << "{}";
-        return out;
-    }
-
-    out << "{";
-    auto it = d.begin();
-    while (1) {
-        auto newIt = it;
-        newIt++;
-        if (newIt == d.end()) {
-            break;
-        }
-        out << *it << ", ";
-
-        it = newIt;
-    }
-    out << *it << "}";
-
-    return out;
+    return dict::_printDict(out, d);
 }
-
@@ -162,22 +162,29 @@ void humancv::getFingers(
 
     Point highestPt(0, INT_MAX);
 
-    vector<FingerData> rawFingers;
+    seq::SmallVec<FingerData, 16> rawFingers;
+
+    out.clear();
+    if (ctr.empty()) {
+        return;
+    }
+
+    // All reads below are within `k` + half the contour of `i`, so they can
+    // go to a padded copy without any wrapping. Kept between calls to reuse
+    // its storage.
+    static thread_local seq::PaddedRing<Point> ring;
+    ring.assign(ctr.s, size_t(k) + ctr.size());
 
     // Store points with angle less than `fingerAngle`, and also find highest
     // point.
     for (int i : xrange(int(ctr.size()))) {
-        curPt = ctr[i];
+        curPt = ring[i];
         if (curPt.y < highestPt.y) {
             highestPt = curPt;
         }
 
-        try {
-            leftPt = ctr[i - k];
-            rightPt = ctr[i + k];
-        } catch (out_of_range &err) {
-            continue;
-        }
+        leftPt = ring[i - k];
+        rightPt = ring[i + k];
 
         float angle = cvutils::geom::ptAngle(leftPt, curPt, rightPt);
         if (    angle < fingerAngle
@@ -191,8 +198,8 @@ void humancv::getFingers(
             int rightI = i + k;
             int leftI = i - k;
             while (rightI - leftI < (int)ctr.size()) {
-                Vec2i v1(ctr[rightI] - ctr[rightI - k / 2]);
-                Vec2i v2(ctr[leftI] - ctr[leftI - k / 2]);
+                Vec2i v1(ring[rightI] - ring[rightI - k / 2]);
+                Vec2i v2(ring[leftI] - ring[leftI - k / 2]);
 
                 if (fabs(cvutils::geom::vecAngle(v1, v2)) > 1) {
                     rawFingers.push_back(FingerData{
@@ -218,15 +225,15 @@ void humancv::getFingers(
             rawFingers
           );
 
-    vector<vector<FingerData>> clusters;
+    static thread_local vector<seq::SmallVec<FingerData, 4>> clusters;
 
-    // Cluster fingers by spatial distance (max distance `k`).
-    seq::cluster(
+    // Cluster fingers by spatial distance (max distance `minDist`).
+    seq::clusterPoints(
             rawFingers,
-            [&](const FingerData &f1, const FingerData &f2) {
-                return cvutils::geom::ptNormSqrd(ctr[int(f1.i)] - ctr[int(f2.i)]);
+            [&](const FingerData &f) {
+                return ctr[int(f.i)];
             },
-            minDist * minDist,
+            minDist,
             clusters
            );
 
@@ -28,14 +28,28 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
 #include <stdexcept>
 #include <iostream>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <initializer_list>
 #include <iterator>
+#include <limits>
+#include <new>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #include "kmath.hpp"
+#include "thr.hpp"
 
 using namespace std;
 
@@ -46,11 +60,80 @@ using namespace std;
  */
 namespace seq {
 
+/*! Execution policies selecting how the `functional` algorithms run. */
+namespace execution {
+    /*! An execution policy. Use one of the constants below, or build one to
+     * pick the pool and chunk size.
+     */
+    struct Policy {
+        enum Kind { SEQUENCED, PARALLEL, PARALLEL_UNSEQUENCED };
+
+        Kind kind;
+        /*! Pool to run on, or `NULL` for `thr::defaultPool()`. */
+        thr::ThreadPool *pool;
+        /*! Number of elements per task, or 0 to choose automatically. */
+        size_t grain;
+
+        thr::ThreadPool &getPool() const {
+            return this->pool ? *this->pool : thr::defaultPool();
+        }
+
+        /*! Return the number of elements per chunk for an input of size `n`.
+         * Returns `n` (a single chunk) when it's not worth going parallel.
+         */
+        size_t chunkSize(size_t n) const {
+            if (this->kind == SEQUENCED or n == 0) {
+                return max(n, size_t(1));
+            }
+            size_t g = this->grain;
+            if (g == 0) {
+                // a few chunks per worker so stealing can even out the load,
+                // but not so small that task overhead dominates
+                g = max(n / (4 * this->getPool().size()), size_t(2048));
+            }
+            return min(g, n);
+        }
+    };
+
+    /*! Run on the calling thread, in order. */
+    const Policy SEQ = {Policy::SEQUENCED, NULL, 0};
+    /*! Split the input into chunks run on a thread pool. `func` may be
+     * called concurrently from several threads.
+     */
+    const Policy PAR = {Policy::PARALLEL, NULL, 0};
+    /*! Like `PAR`, but calls within a chunk may also be reordered. */
+    const Policy PAR_UNSEQ = {Policy::PARALLEL_UNSEQUENCED, NULL, 0};
+
+    /*! Call `func(chunk, lo, hi)` for each chunk [`lo`, `hi`) of [0, `n`),
+     * running the chunks on the policy's pool if there is more than one.
+     */
+    template <class FuncT>
+    void _forChunks(const Policy &policy, size_t n, size_t chunkSize, const FuncT &func) {
+        size_t nChunks = (n + chunkSize - 1) / chunkSize;
+        if (nChunks <= 1) {
+            func(size_t(0), size_t(0), n);
+            return;
+        }
+        policy.getPool().parallelFor(0, nChunks, 1, [&](size_t chunk) {
+            func(chunk, chunk * chunkSize, min((chunk + 1) * chunkSize, n));
+        });
+    }
+}
+
 /*! Functions commonly used in functional programming.
+ *
+ * Each function also has an overload taking an `execution::Policy` first.
+ * The parallel policies need sequences with random-access iterators.
  */
 namespace functional {
+    /*! `RetT`, but only if `FuncT` isn't an execution policy, so the
+     * overloads taking a policy first are picked for those calls.
+     */
+    template <class FuncT, class RetT>
+    using _IfNotPolicy = typename enable_if<not is_same<FuncT, execution::Policy>::value, RetT>::type;
+
     template <class InSeqT, class OutSeqT, class FuncT>
-    OutSeqT &map(const FuncT &func, const InSeqT &in, OutSeqT &out) {
+    _IfNotPolicy<FuncT, OutSeqT &> map(const FuncT &func, const InSeqT &in, OutSeqT &out) {
         out.resize(in.size());
         transform(in.begin(), in.end(), out.begin(), func);
         return out;
@@ -63,16 +146,34 @@ namespace functional {
     }
 
     template <class InSeqT, class OutSeqT, class FuncT>
-    OutSeqT &filter(const FuncT &test, const InSeqT &in, OutSeqT &out) {
+    OutSeqT &map(const execution::Policy &policy, const FuncT &func, const InSeqT &in, OutSeqT &out) {
+        size_t n = in.size();
+        out.resize(n);
+        auto inBegin = in.begin();
+        auto outBegin = out.begin();
+        execution::_forChunks(policy, n, policy.chunkSize(n), [&](size_t chunk, size_t lo, size_t hi) {
+            transform(inBegin + ptrdiff_t(lo), inBegin + ptrdiff_t(hi), outBegin + ptrdiff_t(lo), func);
+        });
+        return out;
+    }
+
+    template <class InSeqT, class OutSeqT=InSeqT, class FuncT>
+    OutSeqT map(const execution::Policy &policy, const FuncT &func, const InSeqT &in) {
+        OutSeqT out;
+        return map(policy, func, in, out);
+    }
+
+    template <class InSeqT, class OutSeqT, class FuncT>
+    _IfNotPolicy<FuncT, OutSeqT &> filter(const FuncT &test, const InSeqT &in, OutSeqT &out) {
         size_t curI = 0;
-        for (auto elem : in) {
+        for (const auto &elem : in) {
             if (test(elem)) {
                 if (curI < out.size()) {
                     out[curI] = elem;
-                    curI++;
                 } else {
                     out.push_back(elem);
                 }
+                curI++;
             }
         }
         out.resize(curI);
@@ -85,9 +186,68 @@ namespace functional {
         return filter(test, in, out);
     }
 
+    /*! Parallel filter, keeping the order of the kept elements.
+     *
+     * Each chunk first tests its elements and counts the hits, a prefix sum
+     * over the counts gives each chunk its offset in `out`, and then the
+     * chunks copy their hits over in parallel.
+     */
+    template <class InSeqT, class OutSeqT, class FuncT>
+    OutSeqT &filter(const execution::Policy &policy, const FuncT &test, const InSeqT &in, OutSeqT &out) {
+        size_t n = in.size();
+        size_t chunkSize = policy.chunkSize(n);
+        if (chunkSize >= n) {
+            return filter(test, in, out);
+        }
+        if ((const void *)&in == (const void *)&out) {
+            // filtering in place: the copy phase would overwrite elements
+            // other chunks are still reading
+            OutSeqT temp;
+            filter(policy, test, in, temp);
+            out = move(temp);
+            return out;
+        }
+
+        size_t nChunks = (n + chunkSize - 1) / chunkSize;
+        auto inBegin = in.begin();
+        vector<char> keep(n);
+        vector<size_t> offsets(nChunks + 1, 0);
+
+        execution::_forChunks(policy, n, chunkSize, [&](size_t chunk, size_t lo, size_t hi) {
+            size_t count = 0;
+            for (size_t i = lo; i < hi; i++) {
+                keep[i] = test(*(inBegin + ptrdiff_t(i))) ? 1 : 0;
+                count += size_t(keep[i]);
+            }
+            offsets[chunk + 1] = count;
+        });
+        for (size_t chunk = 0; chunk < nChunks; chunk++) {
+            offsets[chunk + 1] += offsets[chunk];
+        }
+
+        out.resize(offsets[nChunks]);
+        auto outBegin = out.begin();
+        execution::_forChunks(policy, n, chunkSize, [&](size_t chunk, size_t lo, size_t hi) {
+            auto outIt = outBegin + ptrdiff_t(offsets[chunk]);
+            for (size_t i = lo; i < hi; i++) {
+                if (keep[i]) {
+                    *outIt = *(inBegin + ptrdiff_t(i));
+                    ++outIt;
+                }
+            }
+        });
+        return out;
+    }
+
+    template <class InSeqT, class OutSeqT=InSeqT, class FuncT>
+    OutSeqT filter(const execution::Policy &policy, const FuncT &test, const InSeqT &in) {
+        OutSeqT out;
+        return filter(policy, test, in, out);
+    }
+
     template<class SeqT, class FuncT>
     bool any(const FuncT &test, const SeqT &in) {
-        for (auto elem : in) {
+        for (const auto &elem : in) {
             if (test(elem)) {
                 return true;
             }
@@ -95,47 +255,411 @@ namespace functional {
         return false;
     }
 
+    /*! Parallel any(). Once some chunk finds a match, the other chunks stop
+     * early.
+     */
+    template<class SeqT, class FuncT>
+    bool any(const execution::Policy &policy, const FuncT &test, const SeqT &in) {
+        size_t n = in.size();
+        auto inBegin = in.begin();
+        atomic<bool> found(false);
+        execution::_forChunks(policy, n, policy.chunkSize(n), [&](size_t chunk, size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi and not found.load(memory_order_relaxed); i++) {
+                if (test(*(inBegin + ptrdiff_t(i)))) {
+                    found.store(true, memory_order_relaxed);
+                }
+            }
+        });
+        return found.load();
+    }
+
     template<class SeqT, class FuncT>
     bool all(const FuncT &test, const SeqT &in) {
-        for (auto elem : in) {
+        for (const auto &elem : in) {
             if (not test(elem)) {
                 return false;
             }
         }
         return true;
     }
+
+    /*! Parallel all(). Once some chunk finds a failing element, the other
+     * chunks stop early.
+     */
+    template<class SeqT, class FuncT>
+    bool all(const execution::Policy &policy, const FuncT &test, const SeqT &in) {
+        return not any(policy, [&](const typename SeqT::value_type &elem) { return not test(elem); }, in);
+    }
+}
+
+/*! Lazy, read-only views over sequences.
+ *
+ * Views compute their elements on the fly while being iterated, so chains
+ * like `view::map(f, view::filter(test, v))` make a single pass over `v` and
+ * allocate nothing. Only collect() builds a container.
+ *
+ * A view refers to an lvalue sequence (which must outlive it) and takes
+ * ownership of rvalues, so views can be nested directly.
+ *
+ * Suggested usage:
+ *
+ *      for (auto p : view::enumerate(view::filter(isFinger, pts))) {
+ *          print(p.first, p.second);
+ *      }
+ *
+ *      vector<float> dists = view::collect<vector<float>>(view::map(getDist, pts));
+ */
+namespace view {
+    template <class SeqT>
+    using _IterT = decltype(declval<const typename remove_reference<SeqT>::type &>().begin());
+
+    /*! View yielding `func(elem)` for each element. */
+    template <class SeqT, class FuncT>
+    struct MapView {
+        typedef _IterT<SeqT> BaseIterT;
+        typedef typename decay<decltype(declval<const FuncT &>()(*declval<BaseIterT>()))>::type value_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef typename MapView::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef value_type reference;
+
+            BaseIterT it;
+            const FuncT *func;
+
+            value_type operator*() const { return (*this->func)(*this->it); }
+            iterator &operator++() { ++this->it; return *this; }
+            bool operator==(const iterator &other) const { return this->it == other.it; }
+            bool operator!=(const iterator &other) const { return this->it != other.it; }
+        };
+        typedef iterator const_iterator;
+
+        SeqT seq;
+        FuncT func;
+
+        iterator begin() const { return iterator{this->seq.begin(), &this->func}; }
+        iterator end() const { return iterator{this->seq.end(), &this->func}; }
+        size_t size() const { return this->seq.size(); }
+        bool empty() const { return this->seq.empty(); }
+    };
+
+    /*! View yielding only the elements for which `test(elem)` is true. */
+    template <class SeqT, class FuncT>
+    struct FilterView {
+        typedef _IterT<SeqT> BaseIterT;
+        typedef typename iterator_traits<BaseIterT>::value_type value_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef typename FilterView::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef typename iterator_traits<BaseIterT>::pointer pointer;
+            typedef typename iterator_traits<BaseIterT>::reference reference;
+
+            BaseIterT it;
+            BaseIterT end;
+            const FuncT *test;
+
+            void skip() {
+                while (this->it != this->end and not (*this->test)(*this->it)) {
+                    ++this->it;
+                }
+            }
+
+            reference operator*() const { return *this->it; }
+            iterator &operator++() { ++this->it; this->skip(); return *this; }
+            bool operator==(const iterator &other) const { return this->it == other.it; }
+            bool operator!=(const iterator &other) const { return this->it != other.it; }
+        };
+        typedef iterator const_iterator;
+
+        SeqT seq;
+        FuncT test;
+
+        iterator begin() const {
+            iterator res{this->seq.begin(), this->seq.end(), &this->test};
+            res.skip();
+            return res;
+        }
+        iterator end() const { return iterator{this->seq.end(), this->seq.end(), &this->test}; }
+        bool empty() const { return not (this->begin() != this->end()); }
+    };
+
+    /*! View yielding at most the first `n` elements. */
+    template <class SeqT>
+    struct TakeView {
+        typedef _IterT<SeqT> BaseIterT;
+        typedef typename iterator_traits<BaseIterT>::value_type value_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef typename TakeView::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef typename iterator_traits<BaseIterT>::pointer pointer;
+            typedef typename iterator_traits<BaseIterT>::reference reference;
+
+            BaseIterT it;
+            // elements left to take
+            size_t left;
+
+            reference operator*() const { return *this->it; }
+            iterator &operator++() { ++this->it; --this->left; return *this; }
+            // either running out of elements or reaching the underlying end
+            // counts as reaching the end
+            bool operator==(const iterator &other) const {
+                return this->left == other.left or this->it == other.it;
+            }
+            bool operator!=(const iterator &other) const { return not (*this == other); }
+        };
+        typedef iterator const_iterator;
+
+        SeqT seq;
+        size_t n;
+
+        iterator begin() const { return iterator{this->seq.begin(), this->n}; }
+        iterator end() const { return iterator{this->seq.end(), 0}; }
+        bool empty() const { return this->n == 0 or this->seq.empty(); }
+    };
+
+    /*! View yielding `pair`s of corresponding elements, stopping at the end
+     * of the shorter sequence.
+     */
+    template <class SeqT1, class SeqT2>
+    struct ZipView {
+        typedef _IterT<SeqT1> BaseIterT1;
+        typedef _IterT<SeqT2> BaseIterT2;
+        typedef pair<
+                typename iterator_traits<BaseIterT1>::reference,
+                typename iterator_traits<BaseIterT2>::reference
+                > value_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef typename ZipView::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef value_type reference;
+
+            BaseIterT1 it1;
+            BaseIterT2 it2;
+
+            value_type operator*() const { return value_type(*this->it1, *this->it2); }
+            iterator &operator++() { ++this->it1; ++this->it2; return *this; }
+            // reaching either end counts as reaching the end
+            bool operator==(const iterator &other) const {
+                return this->it1 == other.it1 or this->it2 == other.it2;
+            }
+            bool operator!=(const iterator &other) const { return not (*this == other); }
+        };
+        typedef iterator const_iterator;
+
+        SeqT1 seq1;
+        SeqT2 seq2;
+
+        iterator begin() const { return iterator{this->seq1.begin(), this->seq2.begin()}; }
+        iterator end() const { return iterator{this->seq1.end(), this->seq2.end()}; }
+        size_t size() const { return min(this->seq1.size(), this->seq2.size()); }
+        bool empty() const { return this->seq1.empty() or this->seq2.empty(); }
+    };
+
+    /*! View yielding `pair`s of (index, element). */
+    template <class SeqT>
+    struct EnumerateView {
+        typedef _IterT<SeqT> BaseIterT;
+        typedef pair<size_t, typename iterator_traits<BaseIterT>::reference> value_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef typename EnumerateView::value_type value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef value_type reference;
+
+            BaseIterT it;
+            size_t i;
+
+            value_type operator*() const { return value_type(this->i, *this->it); }
+            iterator &operator++() { ++this->it; ++this->i; return *this; }
+            bool operator==(const iterator &other) const { return this->it == other.it; }
+            bool operator!=(const iterator &other) const { return this->it != other.it; }
+        };
+        typedef iterator const_iterator;
+
+        SeqT seq;
+
+        iterator begin() const { return iterator{this->seq.begin(), 0}; }
+        iterator end() const { return iterator{this->seq.end(), 0}; }
+        size_t size() const { return this->seq.size(); }
+        bool empty() const { return this->seq.empty(); }
+    };
+
+    template <class FuncT, class SeqT>
+    MapView<SeqT, typename decay<FuncT>::type> map(FuncT &&func, SeqT &&seq) {
+        return MapView<SeqT, typename decay<FuncT>::type>{forward<SeqT>(seq), forward<FuncT>(func)};
+    }
+
+    template <class FuncT, class SeqT>
+    FilterView<SeqT, typename decay<FuncT>::type> filter(FuncT &&test, SeqT &&seq) {
+        return FilterView<SeqT, typename decay<FuncT>::type>{forward<SeqT>(seq), forward<FuncT>(test)};
+    }
+
+    template <class SeqT>
+    TakeView<SeqT> take(size_t n, SeqT &&seq) {
+        return TakeView<SeqT>{forward<SeqT>(seq), n};
+    }
+
+    template <class SeqT1, class SeqT2>
+    ZipView<SeqT1, SeqT2> zip(SeqT1 &&seq1, SeqT2 &&seq2) {
+        return ZipView<SeqT1, SeqT2>{forward<SeqT1>(seq1), forward<SeqT2>(seq2)};
+    }
+
+    template <class SeqT>
+    EnumerateView<SeqT> enumerate(SeqT &&seq) {
+        return EnumerateView<SeqT>{forward<SeqT>(seq)};
+    }
+
+    /*! Store the elements of `v` in `out` (replacing its contents) and return
+     * `out`.
+     */
+    template <class ViewT, class OutSeqT>
+    OutSeqT &collect(const ViewT &v, OutSeqT &out) {
+        out.clear();
+        for (auto &&elem : v) {
+            out.push_back(elem);
+        }
+        return out;
+    }
+
+    /*! Return a new `OutSeqT` holding the elements of `v`. */
+    template <class OutSeqT, class ViewT>
+    OutSeqT collect(const ViewT &v) {
+        OutSeqT out;
+        return collect(v, out);
+    }
 }
 
 /*! Mathematical operations on sequences, and sequence structures. */
 namespace math {
+    /*! Number of elements of an `XRange` over integers. `step` must not be
+     * 0.
+     */
+    template <class NumT>
+    constexpr size_t _xrangeCount(NumT low, NumT high, NumT step, bool inclusive, false_type) {
+        return step > NumT(0)
+            ? (high < low or (high == low and not inclusive) ? 0 :
+               size_t((high - low) / step) + (inclusive or (high - low) % step != 0 ? 1 : 0))
+            : (low < high or (high == low and not inclusive) ? 0 :
+               size_t((low - high) / (NumT(0) - step)) +
+               (inclusive or (low - high) % (NumT(0) - step) != 0 ? 1 : 0));
+    }
+
+    /*! `q`, snapped to the nearest integer if it's within rounding error of
+     * it, so that e.g. `xrange(0., 1., .1)` has exactly 10 elements.
+     */
+    template <class NumT>
+    constexpr NumT _snapToInt(NumT q, NumT nearest) {
+        return (q < nearest ? nearest - q : q - nearest) <= q * numeric_limits<NumT>::epsilon() * 4
+            ? nearest : q;
+    }
+
+    /*! Number of steps of size 1 from 0 to `q` >= 0, `inclusive` or not. */
+    template <class NumT>
+    constexpr size_t _stepsTo(NumT q, bool inclusive) {
+        return inclusive ? size_t(q) + 1 : size_t(q) + (NumT(size_t(q)) < q ? 1 : 0);
+    }
+
+    /*! Number of elements of an `XRange` over floating point numbers. */
+    template <class NumT>
+    constexpr size_t _xrangeCount(NumT low, NumT high, NumT step, bool inclusive, true_type) {
+        return (step > 0 ? high < low : low < high) or (high == low and not inclusive) ? 0 :
+            _stepsTo(_snapToInt((high - low) / step, NumT(size_t((high - low) / step + NumT(.5)))),
+                     inclusive);
+    }
+
+    /*! Arithmetic progression of `count` numbers `start`, `start + step`, ...
+     * computed as `start + i * step`, so floating point ranges don't drift.
+     * Random access, with O(1) `size()` and `operator[]`.
+     */
     template <class NumT>
     struct XRange {
+        typedef NumT value_type;
+        typedef NumT reference;
+        typedef NumT const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
         struct iterator {
-            NumT e;
+            typedef random_access_iterator_tag iterator_category;
+            typedef NumT value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const NumT *pointer;
+            typedef NumT reference;
+
+            NumT start;
             NumT step;
-            bool inclusive;
-
-            NumT operator*(void) { return e; }
-            void operator++(void) { e += step; }
-            bool operator!=(const iterator &other) {
-                // Yes, this breaks symmetry. This will work since the standard
-                // specifies that the iterators will be compared as `begin !=
-                // end` instead of `end != begin`.
-                if (inclusive) {
-                    return e <= other.e;
-                } else {
-                    return e < other.e;
-                }
+            ptrdiff_t i;
+
+            constexpr NumT operator*() const { return NumT(this->start + NumT(this->i) * this->step); }
+            constexpr NumT operator[](ptrdiff_t n) const {
+                return NumT(this->start + NumT(this->i + n) * this->step);
             }
+            iterator &operator++() { ++this->i; return *this; }
+            iterator operator++(int) { iterator old = *this; ++this->i; return old; }
+            iterator &operator--() { --this->i; return *this; }
+            iterator operator--(int) { iterator old = *this; --this->i; return old; }
+            iterator &operator+=(ptrdiff_t n) { this->i += n; return *this; }
+            iterator &operator-=(ptrdiff_t n) { this->i -= n; return *this; }
+            constexpr iterator operator+(ptrdiff_t n) const { return iterator{this->start, this->step, this->i + n}; }
+            constexpr iterator operator-(ptrdiff_t n) const { return iterator{this->start, this->step, this->i - n}; }
+            constexpr ptrdiff_t operator-(const iterator &other) const { return this->i - other.i; }
+            constexpr bool operator==(const iterator &other) const { return this->i == other.i; }
+            constexpr bool operator!=(const iterator &other) const { return this->i != other.i; }
+            constexpr bool operator<(const iterator &other) const { return this->i < other.i; }
+            constexpr bool operator>(const iterator &other) const { return this->i > other.i; }
+            constexpr bool operator<=(const iterator &other) const { return this->i <= other.i; }
+            constexpr bool operator>=(const iterator &other) const { return this->i >= other.i; }
         };
+        typedef iterator const_iterator;
+
+        /*! Selects the constructor taking an element count. */
+        struct ByCount {};
 
         NumT start;
-        NumT stop;
         NumT step;
-        bool inclusive;
+        size_t count;
+
+        /*! Range from `low` up to `high` (down to, if `step` < 0), including
+         * `high` only if `inclusive`. `step` must not be 0.
+         */
+        constexpr XRange(NumT low, NumT high, NumT step=1, bool inclusive=false)
+            : start(low), step(step),
+              count(_xrangeCount(low, high, step, inclusive,
+                                 typename is_floating_point<NumT>::type())) {}
+        constexpr XRange(NumT start, NumT step, size_t count, ByCount)
+            : start(start), step(step), count(count) {}
 
-        iterator begin(void) { return iterator{start, step, inclusive}; }
-        iterator end(void) { return iterator{stop, 0, inclusive}; }
+        constexpr size_t size() const { return this->count; }
+        constexpr bool empty() const { return this->count == 0; }
+        constexpr NumT operator[](size_t i) const { return NumT(this->start + NumT(i) * this->step); }
+        constexpr iterator begin() const { return iterator{this->start, this->step, 0}; }
+        constexpr iterator end() const { return iterator{this->start, this->step, ptrdiff_t(this->count)}; }
+
+        /*! Split into at most `n` consecutive, non-empty subranges whose sizes
+         * differ by at most 1, e.g. one per thread pool worker.
+         */
+        vector<XRange> split(size_t n) const {
+            vector<XRange> parts;
+            n = min(n, this->count);
+            size_t first = 0;
+            for (size_t part = 0; part < n; part++) {
+                size_t partSize = this->count / n + (part < this->count % n ? 1 : 0);
+                parts.push_back(XRange((*this)[first], this->step, partSize, ByCount()));
+                first += partSize;
+            }
+            return parts;
+        }
     };
 
     /*! Return `XRange` sequence, similar to Python's "xrange".
@@ -150,15 +674,262 @@ namespace math {
      * include the endpoint of the range by specifying `inclusive` = `true`.
      */
     template <class NumT>
-    XRange<NumT> xrange(NumT low, NumT high, NumT step=1, bool inclusive=false) {
-        return XRange<NumT>{low, high, step, inclusive};
+    constexpr XRange<NumT> xrange(NumT low, NumT high, NumT step=1, bool inclusive=false) {
+        return XRange<NumT>(low, high, step, inclusive);
     }
 
     template <class NumT>
-    XRange<NumT> xrange(NumT high, bool inclusive=false) {
+    constexpr XRange<NumT> xrange(NumT high, bool inclusive=false) {
         return xrange<NumT>(0, high, 1, inclusive);
     }
 
+    /*! Call `func(x)` for each `x` in `range`, in chunks spread over the
+     * pool of `policy`.
+     */
+    template <class NumT, class FuncT>
+    void parallelFor(const execution::Policy &policy, const XRange<NumT> &range, const FuncT &func) {
+        size_t n = range.size();
+        execution::_forChunks(policy, n, policy.chunkSize(n), [&](size_t, size_t lo, size_t hi) {
+            for (size_t i = lo; i < hi; i++) {
+                func(range[i]);
+            }
+        });
+    }
+
+    /*! Order in which an `XRangeND` visits its points. */
+    enum TraversalOrder {
+        /*! Last dimension fastest, like nested loops. */
+        ROW_MAJOR,
+        /*! Tile by tile (tiles themselves in row-major order), row-major
+         * within each tile, so neighbouring rows stay in cache.
+         */
+        TILED,
+        /*! Tile by tile, Z-order (Morton order) within each tile. Tile sizes
+         * are rounded up to a power of 2, but no larger than needed to cover
+         * the box.
+         */
+        MORTON
+    };
+
+    /*! Box of `N`-dimensional integer points `low` <= p < `high`, iterated
+     * in a `TraversalOrder`. Elements are `array<size_t, N>`. Iterators
+     * refer back to the range, so it must outlive them.
+     */
+    template <size_t N>
+    struct XRangeND {
+        typedef array<size_t, N> value_type;
+        typedef value_type reference;
+        typedef value_type const_reference;
+        typedef size_t size_type;
+        typedef ptrdiff_t difference_type;
+
+        struct iterator {
+            typedef forward_iterator_tag iterator_category;
+            typedef array<size_t, N> value_type;
+            typedef ptrdiff_t difference_type;
+            typedef const value_type *pointer;
+            typedef const value_type &reference;
+
+            const XRangeND *range;
+            // number of points visited so far
+            size_t pos;
+            value_type coord;
+            value_type tileOrigin;
+            // Morton code of `coord` within its tile
+            size_t code;
+
+            reference operator*() const { return this->coord; }
+            pointer operator->() const { return &this->coord; }
+            bool operator==(const iterator &other) const { return this->pos == other.pos; }
+            bool operator!=(const iterator &other) const { return this->pos != other.pos; }
+
+            iterator &operator++() {
+                const XRangeND &r = *this->range;
+                if (++this->pos >= r.size()) {
+                    return *this;
+                }
+                switch (r.order) {
+                    case ROW_MAJOR:
+                        _increment(this->coord, r.low, r.high, 1);
+                        break;
+                    case TILED:
+                        if (not _increment(this->coord, this->tileOrigin, this->tileEnd(), 1)) {
+                            this->nextTile();
+                            this->coord = this->tileOrigin;
+                        }
+                        break;
+                    case MORTON:
+                        // edge tiles stick out of the box, skip those points a
+                        // whole block at a time
+                        this->code++;
+                        while (1) {
+                            if (this->code == r._tileVolume()) {
+                                this->nextTile();
+                                this->code = 0;
+                            }
+                            this->coord = this->tileOrigin;
+                            _addMorton(this->coord, this->code);
+                            if (r._contains(this->coord)) {
+                                break;
+                            }
+                            this->code += r._mortonBlock(this->code);
+                        }
+                        break;
+                }
+                return *this;
+            }
+            iterator operator++(int) {
+                iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            value_type tileEnd() const {
+                value_type end;
+                for (size_t d = 0; d < N; d++) {
+                    end[d] = min(this->tileOrigin[d] + this->range->tile, this->range->high[d]);
+                }
+                return end;
+            }
+
+            void nextTile() {
+                _increment(this->tileOrigin, this->range->low, this->range->high, this->range->tile);
+            }
+        };
+        typedef iterator const_iterator;
+
+        value_type low;
+        value_type high;
+        TraversalOrder order;
+        // tile side length, for `TILED`, `MORTON` and `tiles()`
+        size_t tile;
+
+        XRangeND(const value_type &low, const value_type &high, TraversalOrder order=ROW_MAJOR,
+                 size_t tile=32)
+                : low(low), high(high), order(order), tile(max(tile, size_t(1))) {
+            if (order == MORTON) {
+                // a tile bigger than the box only adds codes to skip
+                size_t extent = 1;
+                for (size_t d = 0; d < N; d++) {
+                    extent = max(extent, high[d] > low[d] ? high[d] - low[d] : 0);
+                }
+                size_t pow2 = 1;
+                while (pow2 < min(this->tile, extent)) {
+                    pow2 *= 2;
+                }
+                this->tile = pow2;
+            }
+        }
+
+        size_t size() const {
+            size_t n = 1;
+            for (size_t d = 0; d < N; d++) {
+                n *= this->high[d] > this->low[d] ? this->high[d] - this->low[d] : 0;
+            }
+            return n;
+        }
+        bool empty() const { return this->size() == 0; }
+
+        iterator begin() const {
+            return iterator{this, 0, this->low, this->low, 0};
+        }
+        iterator end() const {
+            return iterator{this, this->size(), this->high, this->high, 0};
+        }
+
+        /*! Split into boxes of at most `tile` points per side, in row-major
+         * order of the tiles, each iterated in this range's order. Meant for
+         * handing out to pool workers.
+         */
+        vector<XRangeND> tiles() const {
+            vector<XRangeND> res;
+            if (this->empty()) {
+                return res;
+            }
+            value_type origin = this->low;
+            do {
+                value_type end;
+                for (size_t d = 0; d < N; d++) {
+                    end[d] = min(origin[d] + this->tile, this->high[d]);
+                }
+                res.push_back(XRangeND(origin, end, this->order, this->tile));
+            } while (_increment(origin, this->low, this->high, this->tile));
+            return res;
+        }
+
+        /*! Advance `coord` by `step` in row-major order within `[from, to)`.
+         * Return `false` (with `coord` back at `from`) when it wraps around.
+         */
+        static bool _increment(value_type &coord, const value_type &from, const value_type &to,
+                               size_t step) {
+            for (size_t d = N; d-- > 0;) {
+                coord[d] += step;
+                if (coord[d] < to[d]) {
+                    return true;
+                }
+                coord[d] = from[d];
+            }
+            return false;
+        }
+
+        /*! Add the point with Morton code `code` to `coord`. The last
+         * dimension takes the lowest bit of each group of `N`.
+         */
+        static void _addMorton(value_type &coord, size_t code) {
+            for (size_t bit = 0; code != 0; bit++) {
+                for (size_t d = N; d-- > 0; code >>= 1) {
+                    coord[d] += (code & 1) << bit;
+                }
+            }
+        }
+
+        /*! Return the number of codes in the largest aligned Z-order block
+         * starting at `code`. If the point at `code` is outside the box, so is
+         * the whole block: its coordinates are all at least as large.
+         */
+        size_t _mortonBlock(size_t code) const {
+            size_t block = 1;
+            for (size_t side = 1; side < this->tile; side *= 2) {
+                size_t bigger = block << N;
+                if ((code & (bigger - 1)) != 0) {
+                    break;
+                }
+                block = bigger;
+            }
+            return block;
+        }
+
+        size_t _tileVolume() const {
+            size_t n = 1;
+            for (size_t d = 0; d < N; d++) {
+                n *= this->tile;
+            }
+            return n;
+        }
+
+        bool _contains(const value_type &coord) const {
+            for (size_t d = 0; d < N; d++) {
+                if (coord[d] < this->low[d] or coord[d] >= this->high[d]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    /*! Return an `XRangeND` over `rows` x `cols` points (row, column). */
+    inline XRangeND<2> xrange2d(size_t rows, size_t cols, TraversalOrder order=ROW_MAJOR,
+                                size_t tile=32) {
+        return XRangeND<2>({{0, 0}}, {{rows, cols}}, order, tile);
+    }
+
+    /*! Return an `XRangeND` over all points with 0 <= p[d] < `shape[d]`. */
+    template <size_t N>
+    XRangeND<N> xrangeND(const array<size_t, N> &shape, TraversalOrder order=ROW_MAJOR,
+                         size_t tile=32) {
+        return XRangeND<N>(array<size_t, N>(), shape, order, tile);
+    }
+
     /*! Construct a sequence of numbers from `low` to `high` with optional
      * `step`, store it in `out`, and return `out`.
      */
@@ -189,39 +960,378 @@ namespace math {
     /*! Return the sum of sequence elements. */
     template <class SeqT>
     typename SeqT::value_type sum(const SeqT &in) {
-        typename SeqT::value_type res;
-        for (auto elem : in) {
+        typename SeqT::value_type res = typename SeqT::value_type();
+        for (const auto &elem : in) {
             res += elem;
         }
         return res;
     }
 
-    /*! Return the arithmetic mean of sequence elements. */
-    template <class SeqT>
-    typename SeqT::value_type mean(const SeqT &in) {
-        return sum(in) / in.size();
-    }
-}
+    /*! How to accumulate floating point sums. */
+    enum SumMode {
+        /*! Plain SIMD accumulation; error grows linearly with size. */
+        FAST,
+        /*! Sum blocks, then add the block sums pairwise; error grows
+         * logarithmically with size, at almost no extra cost.
+         */
+        PAIRWISE,
+        /*! Kahan compensated summation; error independent of size, about 4x
+         * the arithmetic of `FAST`.
+         */
+        KAHAN
+    };
 
-/*! Get the wrapped index to an array of size `sz`. Throw `length_error` if `sz`
- * == 0.
- */
-inline size_t _realI(int i, size_t sz) {
-    if (sz == 0) {
-        throw length_error("`sz` must be != 0");
-    }
-    i %= int(sz);
-    if (i < 0) {
-        i += int(sz);
-    }
-    return size_t(i);
-}
+    /*! Scalar stand-in for `_Simd`, used for the tails of the SIMD loops and
+     * for types without a vector specialization.
+     */
+    template <class T>
+    struct _Scalar {
+        typedef T V;
+        static const size_t WIDTH = 1;
 
-/*! Get the wrapped distance between left and right indices in an array of size
- * `sz`. For example, `_realIDist(3, 0, 4)` == 1.
- */
-inline size_t _realIDist(size_t leftI, size_t rightI, size_t sz) {
-    if (rightI >= leftI) {
+        static V zero() { return T(0); }
+        static V load(const T *p) { return *p; }
+        static V add(V a, V b) { return a + b; }
+        static V sub(V a, V b) { return a - b; }
+        static V mul(V a, V b) { return a * b; }
+        static V vmin(V a, V b) { return b < a ? b : a; }
+        static V vmax(V a, V b) { return a < b ? b : a; }
+        static void store(T *p, V v) { *p = v; }
+    };
+
+    /*! Thin wrapper over the widest SIMD registers available at compile
+     * time, so the reduction kernels below are written once.
+     */
+    template <class T>
+    struct _Simd : _Scalar<T> {};
+
+#if defined(__AVX__)
+    template <>
+    struct _Simd<float> {
+        typedef __m256 V;
+        static const size_t WIDTH = 8;
+
+        static V zero() { return _mm256_setzero_ps(); }
+        static V load(const float *p) { return _mm256_loadu_ps(p); }
+        static V add(V a, V b) { return _mm256_add_ps(a, b); }
+        static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+        static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+        static V vmin(V a, V b) { return _mm256_min_ps(a, b); }
+        static V vmax(V a, V b) { return _mm256_max_ps(a, b); }
+        static void store(float *p, V v) { _mm256_storeu_ps(p, v); }
+    };
+
+    template <>
+    struct _Simd<double> {
+        typedef __m256d V;
+        static const size_t WIDTH = 4;
+
+        static V zero() { return _mm256_setzero_pd(); }
+        static V load(const double *p) { return _mm256_loadu_pd(p); }
+        static V add(V a, V b) { return _mm256_add_pd(a, b); }
+        static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+        static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+        static V vmin(V a, V b) { return _mm256_min_pd(a, b); }
+        static V vmax(V a, V b) { return _mm256_max_pd(a, b); }
+        static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+    };
+#elif defined(__SSE2__)
+    template <>
+    struct _Simd<float> {
+        typedef __m128 V;
+        static const size_t WIDTH = 4;
+
+        static V zero() { return _mm_setzero_ps(); }
+        static V load(const float *p) { return _mm_loadu_ps(p); }
+        static V add(V a, V b) { return _mm_add_ps(a, b); }
+        static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+        static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+        static V vmin(V a, V b) { return _mm_min_ps(a, b); }
+        static V vmax(V a, V b) { return _mm_max_ps(a, b); }
+        static void store(float *p, V v) { _mm_storeu_ps(p, v); }
+    };
+
+    template <>
+    struct _Simd<double> {
+        typedef __m128d V;
+        static const size_t WIDTH = 2;
+
+        static V zero() { return _mm_setzero_pd(); }
+        static V load(const double *p) { return _mm_loadu_pd(p); }
+        static V add(V a, V b) { return _mm_add_pd(a, b); }
+        static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+        static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+        static V vmin(V a, V b) { return _mm_min_pd(a, b); }
+        static V vmax(V a, V b) { return _mm_max_pd(a, b); }
+        static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+    };
+#endif
+
+    /*! Combine the lanes of `v` with `S::add`/`S::vmin`/... given as `op`. */
+    template <class S, class T, class OpT>
+    T _horizontal(typename S::V v, OpT op) {
+        T lanes[S::WIDTH];
+        S::store(lanes, v);
+        T res = lanes[0];
+        for (size_t i = 1; i < S::WIDTH; i++) {
+            res = op(res, lanes[i]);
+        }
+        return res;
+    }
+
+    /*! Per-element terms of the reductions below. Each is called with the
+     * register wrapper `S` to use, so the same kernel serves the vector body
+     * and the scalar tail.
+     */
+    struct _Identity {
+        template <class S, class T>
+        static typename S::V term(const T *a, const T *) { return S::load(a); }
+    };
+    struct _Square {
+        template <class S, class T>
+        static typename S::V term(const T *a, const T *) {
+            typename S::V x = S::load(a);
+            return S::mul(x, x);
+        }
+    };
+    struct _Product {
+        template <class S, class T>
+        static typename S::V term(const T *a, const T *b) {
+            return S::mul(S::load(a), S::load(b));
+        }
+    };
+
+    /*! Sum of `KernelT::term` over `n` elements, with four independent
+     * accumulators to hide the latency of the adds.
+     */
+    template <class KernelT, class T>
+    T _reduceFast(const T *a, const T *b, size_t n) {
+        typedef _Simd<T> S;
+        const size_t W = S::WIDTH;
+
+        typename S::V acc0 = S::zero(), acc1 = S::zero(), acc2 = S::zero(), acc3 = S::zero();
+        size_t i = 0;
+        for (; i + 4 * W <= n; i += 4 * W) {
+            acc0 = S::add(acc0, KernelT::template term<S>(a + i, b + i));
+            acc1 = S::add(acc1, KernelT::template term<S>(a + i + W, b + i + W));
+            acc2 = S::add(acc2, KernelT::template term<S>(a + i + 2 * W, b + i + 2 * W));
+            acc3 = S::add(acc3, KernelT::template term<S>(a + i + 3 * W, b + i + 3 * W));
+        }
+        for (; i + W <= n; i += W) {
+            acc0 = S::add(acc0, KernelT::template term<S>(a + i, b + i));
+        }
+        T res = _horizontal<S, T>(S::add(S::add(acc0, acc1), S::add(acc2, acc3)), _Scalar<T>::add);
+        for (; i < n; i++) {
+            res += KernelT::template term<_Scalar<T> >(a + i, b + i);
+        }
+        return res;
+    }
+
+    /*! Kahan-compensated version of `_reduceFast`, one compensation term per
+     * lane.
+     */
+    template <class KernelT, class T>
+    T _reduceKahan(const T *a, const T *b, size_t n) {
+        typedef _Simd<T> S;
+        const size_t W = S::WIDTH;
+
+        typename S::V acc = S::zero(), comp = S::zero();
+        size_t i = 0;
+        for (; i + W <= n; i += W) {
+            typename S::V y = S::sub(KernelT::template term<S>(a + i, b + i), comp);
+            typename S::V t = S::add(acc, y);
+            comp = S::sub(S::sub(t, acc), y);
+            acc = t;
+        }
+
+        T accLanes[S::WIDTH], compLanes[S::WIDTH];
+        S::store(accLanes, acc);
+        S::store(compLanes, comp);
+        T res = 0, c = 0;
+        for (size_t lane = 0; lane < W; lane++) {
+            T y = accLanes[lane] - compLanes[lane] - c;
+            T t = res + y;
+            c = (t - res) - y;
+            res = t;
+        }
+        for (; i < n; i++) {
+            T y = KernelT::template term<_Scalar<T> >(a + i, b + i) - c;
+            T t = res + y;
+            c = (t - res) - y;
+            res = t;
+        }
+        return res;
+    }
+
+    /*! Elements summed with `_reduceFast` at the leaves of the pairwise
+     * recursion.
+     */
+    const size_t _PAIRWISE_BLOCK = 256;
+
+    template <class KernelT, class T>
+    T _reducePairwise(const T *a, const T *b, size_t n) {
+        if (n <= _PAIRWISE_BLOCK) {
+            return _reduceFast<KernelT>(a, b, n);
+        }
+        size_t half = n / 2;
+        return _reducePairwise<KernelT>(a, b, half) +
+               _reducePairwise<KernelT>(a + half, b + half, n - half);
+    }
+
+    template <class KernelT, class T>
+    T _reduce(const T *a, const T *b, size_t n, SumMode mode) {
+        switch (mode) {
+            case KAHAN:
+                return _reduceKahan<KernelT>(a, b, n);
+            case PAIRWISE:
+                return _reducePairwise<KernelT>(a, b, n);
+            default:
+                return _reduceFast<KernelT>(a, b, n);
+        }
+    }
+
+    /*! Return the sum of the elements of a floating point vector, vectorized
+     * and accumulated as chosen by `mode`.
+     */
+    template <class T>
+    typename enable_if<is_floating_point<T>::value, T>::type
+    sum(const vector<T> &in, SumMode mode = FAST) {
+        return _reduce<_Identity>(in.data(), in.data(), in.size(), mode);
+    }
+
+    /*! Return the sum of the squares of sequence elements. */
+    template <class SeqT>
+    typename SeqT::value_type sumOfSquares(const SeqT &in) {
+        typename SeqT::value_type res = typename SeqT::value_type();
+        for (const auto &elem : in) {
+            res += elem * elem;
+        }
+        return res;
+    }
+    template <class T>
+    typename enable_if<is_floating_point<T>::value, T>::type
+    sumOfSquares(const vector<T> &in, SumMode mode = FAST) {
+        return _reduce<_Square>(in.data(), in.data(), in.size(), mode);
+    }
+
+    /*! Return the dot product of two sequences. Throw `invalid_argument` if
+     * their sizes differ.
+     */
+    template <class SeqT>
+    typename SeqT::value_type dot(const SeqT &a, const SeqT &b) {
+        if (a.size() != b.size()) {
+            throw invalid_argument("`a` and `b` must have the same size");
+        }
+        typename SeqT::value_type res = typename SeqT::value_type();
+        auto bIt = b.begin();
+        for (const auto &elem : a) {
+            res += elem * *bIt;
+            ++bIt;
+        }
+        return res;
+    }
+    template <class T>
+    typename enable_if<is_floating_point<T>::value, T>::type
+    dot(const vector<T> &a, const vector<T> &b, SumMode mode = FAST) {
+        if (a.size() != b.size()) {
+            throw invalid_argument("`a` and `b` must have the same size");
+        }
+        return _reduce<_Product>(a.data(), b.data(), a.size(), mode);
+    }
+
+    /*! Return the smallest and largest of sequence elements. Throw
+     * `length_error` if `in` is empty.
+     */
+    template <class SeqT>
+    pair<typename SeqT::value_type, typename SeqT::value_type> minMax(const SeqT &in) {
+        auto it = in.begin();
+        if (it == in.end()) {
+            throw length_error("`in` must not be empty");
+        }
+        typename SeqT::value_type lo = *it, hi = *it;
+        for (++it; it != in.end(); ++it) {
+            if (*it < lo) {
+                lo = *it;
+            } else if (hi < *it) {
+                hi = *it;
+            }
+        }
+        return make_pair(lo, hi);
+    }
+    template <class T>
+    typename enable_if<is_floating_point<T>::value, pair<T, T> >::type
+    minMax(const vector<T> &in) {
+        typedef _Simd<T> S;
+        const size_t W = S::WIDTH;
+        size_t n = in.size();
+        if (n == 0) {
+            throw length_error("`in` must not be empty");
+        }
+
+        const T *p = in.data();
+        size_t i = 0;
+        T lo = p[0], hi = p[0];
+        if (n >= W) {
+            typename S::V vLo = S::load(p), vHi = vLo;
+            for (i = W; i + W <= n; i += W) {
+                typename S::V x = S::load(p + i);
+                vLo = S::vmin(vLo, x);
+                vHi = S::vmax(vHi, x);
+            }
+            lo = _horizontal<S, T>(vLo, _Scalar<T>::vmin);
+            hi = _horizontal<S, T>(vHi, _Scalar<T>::vmax);
+        }
+        for (; i < n; i++) {
+            lo = _Scalar<T>::vmin(lo, p[i]);
+            hi = _Scalar<T>::vmax(hi, p[i]);
+        }
+        return make_pair(lo, hi);
+    }
+
+    /*! Return the arithmetic mean of sequence elements. */
+    template <class SeqT>
+    typename SeqT::value_type mean(const SeqT &in) {
+        return sum(in) / in.size();
+    }
+    template <class T>
+    typename enable_if<is_floating_point<T>::value, T>::type
+    mean(const vector<T> &in, SumMode mode = FAST) {
+        return sum(in, mode) / in.size();
+    }
+}
+
+/*! Get the wrapped index to an array of size `sz`. Throw `length_error` if `sz`
+ * == 0.
+ */
+inline size_t _realI(int i, size_t sz) {
+    if (sz == 0) {
+        throw length_error("`sz` must be != 0");
+    }
+    i %= int(sz);
+    if (i < 0) {
+        i += int(sz);
+    }
+    return size_t(i);
+}
+
+/*! Same as `_realI`, but cheap for `i` within `sz` of `[0, sz)`: one
+ * conditional add or subtract instead of a modulo. Indices further out take
+ * the `_realI` path, which also does the `sz` == 0 check.
+ */
+inline size_t _wrapI(int i, size_t sz) {
+    int n = int(sz);
+    int j = i < 0 ? i + n : (i >= n ? i - n : i);
+    if (size_t(j) < sz) {
+        return size_t(j);
+    }
+    return _realI(i, sz);
+}
+
+/*! Get the wrapped distance between left and right indices in an array of size
+ * `sz`. For example, `_realIDist(3, 0, 4)` == 1.
+ */
+inline size_t _realIDist(size_t leftI, size_t rightI, size_t sz) {
+    if (rightI >= leftI) {
         return rightI - leftI;
     } else {
         return rightI - leftI + sz;
@@ -261,11 +1371,11 @@ struct WrappedSeq {
     //@{
     /*! Wrapped accessor. */
     typename SeqT::reference at(int i) {
-        return this->s.at(this->realI(i));
+        return this->s.at(_realI(i, this->s.size()));
     }
 
     const typename SeqT::reference at(int i) const {
-        return this->s.at(this->realI(i));
+        return this->s.at(_realI(i, this->s.size()));
     }
 
     typename SeqT::reference operator[](int i) {
@@ -289,7 +1399,7 @@ struct WrappedSeq {
 
     /*! Return the real, bounded index from a possibly out-of-bounds one. */
     size_t realI(int i) const {
-        return _realI(i, this->s.size());
+        return _wrapI(i, this->s.size());
     }
 
     /*! Return the real (wrapped) distance between two indices. See
@@ -306,6 +1416,592 @@ struct WrappedSeq {
 
 };
 
+/*! Wrap-around view of a sequence whose size doesn't change while the view is
+ * in use. The size is read once, so power-of-2 sizes wrap with a single mask
+ * and others with `_wrapI`.
+ */
+template <class SeqT>
+class RingView {
+public:
+    explicit RingView(SeqT &s)
+            : s(s), sz(s.size()), mask(s.empty() or (s.size() & (s.size() - 1)) ? 0 : s.size() - 1) {
+    }
+
+    typename SeqT::reference operator[](int i) const {
+        return this->s[this->realI(i)];
+    }
+
+    /*! Return the real, bounded index from a possibly out-of-bounds one. */
+    size_t realI(int i) const {
+        if (this->mask != 0) {
+            return size_t(i) & this->mask;
+        }
+        return _wrapI(i, this->sz);
+    }
+
+    size_t size() const {
+        return this->sz;
+    }
+
+private:
+    SeqT &s;
+    size_t sz;
+    // `sz` - 1 if `sz` is a power of 2 (other than 1), 0 otherwise
+    size_t mask;
+};
+
+/*! Copy of a sequence with `halo` wrapped-around elements added before and
+ * after it, so windowed scans like `ring[i - k]` ... `ring[i + k]` for `i` in
+ * `[0, size())` read contiguous memory with no wrapping at all, as long as
+ * `k` <= `halo`.
+ */
+template <class T>
+class PaddedRing {
+public:
+    PaddedRing() : sz(0), halo(0) {}
+
+    /*! Throw `length_error` if `s` is empty and `halo` > 0. */
+    template <class SeqT>
+    PaddedRing(const SeqT &s, size_t halo) {
+        this->assign(s, halo);
+    }
+
+    /*! Refill from `s`, reusing the storage. Throw `length_error` if `s` is
+     * empty and `halo` > 0.
+     */
+    template <class SeqT>
+    void assign(const SeqT &s, size_t halo) {
+        this->sz = s.size();
+        this->halo = halo;
+        this->data.clear();
+        this->data.reserve(this->sz + 2 * halo);
+        for (size_t j = 0; j < halo; j++) {
+            this->data.push_back(s[_realI(int(j) - int(halo), this->sz)]);
+        }
+        this->data.insert(this->data.end(), s.begin(), s.end());
+        for (size_t j = 0; j < halo; j++) {
+            this->data.push_back(s[_realI(int(j), this->sz)]);
+        }
+    }
+
+    /*! Element `i`, wrapped, for `-halo` <= `i` < `size() + halo`. Not
+     * checked.
+     */
+    const T &operator[](int i) const {
+        return this->data[size_t(i + int(this->halo))];
+    }
+
+    size_t size() const {
+        return this->sz;
+    }
+
+    size_t haloSize() const {
+        return this->halo;
+    }
+
+private:
+    vector<T> data;
+    size_t sz;
+    size_t halo;
+};
+
+/*! `vector`-like sequence that keeps up to `N` elements inline, and only
+ * allocates once it grows past that. For the many tiny per-frame collections,
+ * which then never touch the heap.
+ *
+ * Iterators are pointers. Unlike with `vector`, moving a `SmallVec` whose
+ * elements are inline moves the elements one by one.
+ */
+template <class T, size_t N>
+class SmallVec {
+public:
+    static_assert(N > 0, "`N` must be > 0");
+
+    typedef T value_type;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T *iterator;
+    typedef const T *const_iterator;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    SmallVec() : ptr(this->inlinePtr()), n(0), cap(N) {}
+
+    explicit SmallVec(size_t count) : SmallVec() {
+        this->resize(count);
+    }
+
+    SmallVec(size_t count, const T &value) : SmallVec() {
+        this->resize(count, value);
+    }
+
+    SmallVec(initializer_list<T> items) : SmallVec() {
+        this->reserve(items.size());
+        for (const T &item : items) {
+            new (this->ptr + this->n++) T(item);
+        }
+    }
+
+    template <class IterT, class=typename iterator_traits<IterT>::iterator_category>
+    SmallVec(IterT first, IterT last) : SmallVec() {
+        for (; first != last; ++first) {
+            this->push_back(*first);
+        }
+    }
+
+    SmallVec(const SmallVec &other) : SmallVec() {
+        this->reserve(other.n);
+        for (const T &item : other) {
+            new (this->ptr + this->n++) T(item);
+        }
+    }
+
+    SmallVec(SmallVec &&other) noexcept(is_nothrow_move_constructible<T>::value) : SmallVec() {
+        this->steal(other);
+    }
+
+    ~SmallVec() {
+        this->clear();
+        this->release();
+    }
+
+    SmallVec &operator=(const SmallVec &other) {
+        if (this != &other) {
+            this->clear();
+            this->reserve(other.n);
+            for (const T &item : other) {
+                new (this->ptr + this->n++) T(item);
+            }
+        }
+        return *this;
+    }
+
+    SmallVec &operator=(SmallVec &&other) noexcept(is_nothrow_move_constructible<T>::value) {
+        if (this != &other) {
+            this->clear();
+            this->release();
+            this->steal(other);
+        }
+        return *this;
+    }
+
+    iterator begin() { return this->ptr; }
+    iterator end() { return this->ptr + this->n; }
+    const_iterator begin() const { return this->ptr; }
+    const_iterator end() const { return this->ptr + this->n; }
+
+    size_t size() const { return this->n; }
+    size_t capacity() const { return this->cap; }
+    bool empty() const { return this->n == 0; }
+    /*! Return `true` if the elements are stored inline. */
+    bool isInline() const { return this->ptr == this->inlinePtr(); }
+
+    T *data() { return this->ptr; }
+    const T *data() const { return this->ptr; }
+
+    T &operator[](size_t i) { return this->ptr[i]; }
+    const T &operator[](size_t i) const { return this->ptr[i]; }
+
+    /*! Throw `out_of_range` if `i` >= `size()`. */
+    T &at(size_t i) {
+        if (i >= this->n) {
+            throw out_of_range("`i` must be < size()");
+        }
+        return this->ptr[i];
+    }
+    const T &at(size_t i) const {
+        return const_cast<SmallVec *>(this)->at(i);
+    }
+
+    T &front() { return this->ptr[0]; }
+    const T &front() const { return this->ptr[0]; }
+    T &back() { return this->ptr[this->n - 1]; }
+    const T &back() const { return this->ptr[this->n - 1]; }
+
+    void push_back(const T &item) {
+        if (this->n == this->cap) {
+            // `item` may be one of our own elements
+            T copy(item);
+            this->grow(this->n + 1);
+            new (this->ptr + this->n++) T(move(copy));
+        } else {
+            new (this->ptr + this->n++) T(item);
+        }
+    }
+
+    void push_back(T &&item) {
+        this->emplace_back(move(item));
+    }
+
+    template <class... ArgsT>
+    T &emplace_back(ArgsT &&... args) {
+        if (this->n == this->cap) {
+            T item(forward<ArgsT>(args)...);
+            this->grow(this->n + 1);
+            return *new (this->ptr + this->n++) T(move(item));
+        }
+        return *new (this->ptr + this->n++) T(forward<ArgsT>(args)...);
+    }
+
+    void pop_back() {
+        this->ptr[--this->n].~T();
+    }
+
+    /*! Remove the elements in `[first, last)`, and return an iterator to the
+     * element after them.
+     */
+    iterator erase(const_iterator first, const_iterator last) {
+        iterator dest = this->ptr + (first - this->ptr);
+        iterator src = this->ptr + (last - this->ptr);
+        iterator newEnd = move(src, this->end(), dest);
+        while (this->end() != newEnd) {
+            this->pop_back();
+        }
+        return dest;
+    }
+    iterator erase(const_iterator pos) {
+        return this->erase(pos, pos + 1);
+    }
+
+    void clear() {
+        while (this->n > 0) {
+            this->pop_back();
+        }
+    }
+
+    void reserve(size_t wanted) {
+        if (wanted > this->cap) {
+            this->grow(wanted);
+        }
+    }
+
+    void resize(size_t count) {
+        this->reserve(count);
+        while (this->n < count) {
+            new (this->ptr + this->n++) T();
+        }
+        while (this->n > count) {
+            this->pop_back();
+        }
+    }
+
+    void resize(size_t count, const T &value) {
+        this->reserve(count);
+        while (this->n < count) {
+            new (this->ptr + this->n++) T(value);
+        }
+        while (this->n > count) {
+            this->pop_back();
+        }
+    }
+
+    friend bool operator==(const SmallVec &a, const SmallVec &b) {
+        return a.n == b.n and equal(a.begin(), a.end(), b.begin());
+    }
+    friend bool operator!=(const SmallVec &a, const SmallVec &b) {
+        return not (a == b);
+    }
+
+    /*! Print like other sequences, i.e. as `[a, b, ...]`. */
+    friend ostream &operator<<(ostream &out, const SmallVec &v) {
+        out << "[";
+        for (size_t i = 0; i < v.n; i++) {
+            out << (i == 0 ? "" : ", ") << v.ptr[i];
+        }
+        out << "]";
+        return out;
+    }
+
+private:
+    typename aligned_storage<sizeof(T) * N, alignof(T)>::type inlineBuf;
+    T *ptr;
+    size_t n;
+    size_t cap;
+
+    T *inlinePtr() { return reinterpret_cast<T *>(&this->inlineBuf); }
+    const T *inlinePtr() const { return reinterpret_cast<const T *>(&this->inlineBuf); }
+
+    /*! Move the elements to a heap buffer with room for at least `wanted`. */
+    void grow(size_t wanted) {
+        size_t newCap = max(2 * this->cap, wanted);
+        T *newPtr = static_cast<T *>(::operator new(newCap * sizeof(T)));
+        for (size_t i = 0; i < this->n; i++) {
+            new (newPtr + i) T(move_if_noexcept(this->ptr[i]));
+            this->ptr[i].~T();
+        }
+        this->release();
+        this->ptr = newPtr;
+        this->cap = newCap;
+    }
+
+    /*! Free the heap buffer, if any, and go back to inline storage. The
+     * elements must already be destroyed.
+     */
+    void release() {
+        if (not this->isInline()) {
+            ::operator delete(this->ptr);
+            this->ptr = this->inlinePtr();
+            this->cap = N;
+        }
+    }
+
+    /*! Take the elements of `other`, leaving it empty. `*this` must be empty
+     * and inline.
+     */
+    void steal(SmallVec &other) {
+        if (other.isInline()) {
+            for (size_t i = 0; i < other.n; i++) {
+                new (this->ptr + i) T(move(other.ptr[i]));
+            }
+            this->n = other.n;
+            other.clear();
+        } else {
+            this->ptr = other.ptr;
+            this->n = other.n;
+            this->cap = other.cap;
+            other.ptr = other.inlinePtr();
+            other.n = 0;
+            other.cap = N;
+        }
+    }
+};
+
+/*! Order-preserving map from a radix sort key to an unsigned integer of the
+ * same width, and back.
+ */
+template <class KeyT, class Enable=void>
+struct _RadixKey;
+
+template <class KeyT>
+struct _RadixKey<KeyT, typename enable_if<is_integral<KeyT>::value and is_unsigned<KeyT>::value>::type> {
+    typedef KeyT U;
+    static U encode(KeyT k) { return k; }
+    static KeyT decode(U u) { return u; }
+};
+
+template <class KeyT>
+struct _RadixKey<KeyT, typename enable_if<is_integral<KeyT>::value and is_signed<KeyT>::value>::type> {
+    typedef typename make_unsigned<KeyT>::type U;
+    static const U SIGN = U(U(1) << (8 * sizeof(U) - 1));
+
+    // flipping the sign bit puts negative numbers first
+    static U encode(KeyT k) { return U(U(k) ^ SIGN); }
+    static KeyT decode(U u) { return KeyT(U(u ^ SIGN)); }
+};
+
+template <class KeyT>
+struct _RadixKey<KeyT, typename enable_if<is_floating_point<KeyT>::value>::type> {
+    static_assert(sizeof(KeyT) == 4 or sizeof(KeyT) == 8, "only 32 and 64 bit floats are supported");
+    typedef typename conditional<sizeof(KeyT) == 4, uint32_t, uint64_t>::type U;
+    static const U SIGN = U(U(1) << (8 * sizeof(U) - 1));
+
+    // IEEE 754 bits compare like sign-magnitude integers: flip all bits of
+    // negative numbers, and just the sign bit of positive ones
+    static U encode(KeyT k) {
+        U u;
+        memcpy(&u, &k, sizeof(u));
+        return (u & SIGN) ? U(~u) : U(u | SIGN);
+    }
+    static KeyT decode(U u) {
+        u = (u & SIGN) ? U(u ^ SIGN) : U(~u);
+        KeyT k;
+        memcpy(&k, &u, sizeof(k));
+        return k;
+    }
+};
+
+/*! Below this size, radix sorts fall back to a comparison sort. */
+const size_t _RADIX_MIN_SIZE = 64;
+
+/*! Sort `keys` with a stable LSD radix sort on bytes, applying the same
+ * permutation to `perm` if it's not `NULL`. Passes on bytes that are the same
+ * in all keys are skipped.
+ */
+template <class U>
+void _radixSortKeys(vector<U> &keys, vector<size_t> *perm) {
+    const size_t N_PASSES = sizeof(U);
+    size_t n = keys.size();
+
+    // histograms for all passes in one read
+    vector<array<size_t, 256>> counts(N_PASSES);
+    for (auto &c : counts) {
+        c.fill(0);
+    }
+    for (U k : keys) {
+        for (size_t pass = 0; pass < N_PASSES; pass++) {
+            counts[pass][(k >> (8 * pass)) & 0xff]++;
+        }
+    }
+
+    vector<U> keysBuf(n);
+    vector<size_t> permBuf(perm == NULL ? 0 : n);
+    for (size_t pass = 0; pass < N_PASSES; pass++) {
+        array<size_t, 256> &c = counts[pass];
+        if (find(c.begin(), c.end(), n) != c.end()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (size_t &count : c) {
+            size_t bucketSize = count;
+            count = offset;
+            offset += bucketSize;
+        }
+        for (size_t i = 0; i < n; i++) {
+            size_t dest = c[(keys[i] >> (8 * pass)) & 0xff]++;
+            keysBuf[dest] = keys[i];
+            if (perm != NULL) {
+                permBuf[dest] = (*perm)[i];
+            }
+        }
+        keys.swap(keysBuf);
+        if (perm != NULL) {
+            perm->swap(permBuf);
+        }
+    }
+}
+
+/*! Sort a sequence of integers or floats in ascending order with an LSD
+ * radix sort. Floats are ordered as by `<`, except that -0 comes before 0 and
+ * NaNs go at the ends according to their sign bit.
+ */
+template <class SeqT>
+void radixSort(SeqT &s) {
+    typedef _RadixKey<typename SeqT::value_type> KeyT;
+    typedef typename KeyT::U U;
+
+    size_t n = s.size();
+    if (n < _RADIX_MIN_SIZE) {
+        stable_sort(s.begin(), s.end(), [](typename SeqT::const_reference a, typename SeqT::const_reference b) {
+            return KeyT::encode(a) < KeyT::encode(b);
+        });
+        return;
+    }
+
+    vector<U> keys(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = KeyT::encode(s[i]);
+    }
+    _radixSortKeys(keys, (vector<size_t> *)NULL);
+    for (size_t i = 0; i < n; i++) {
+        s[i] = KeyT::decode(keys[i]);
+    }
+}
+
+/*! Stable sort of a sequence in ascending order of `getKey(elem)`, which
+ * should return an integer or a float, with an LSD radix sort on the keys.
+ */
+template <class SeqT, class KeyFuncT>
+void radixSort(SeqT &s, const KeyFuncT &getKey) {
+    typedef typename SeqT::value_type T;
+    typedef typename decay<decltype(getKey(declval<const T &>()))>::type RawKeyT;
+    typedef _RadixKey<RawKeyT> KeyT;
+    typedef typename KeyT::U U;
+
+    size_t n = s.size();
+    if (n < _RADIX_MIN_SIZE) {
+        stable_sort(s.begin(), s.end(), [&](const T &a, const T &b) {
+            return KeyT::encode(getKey(a)) < KeyT::encode(getKey(b));
+        });
+        return;
+    }
+
+    vector<U> keys(n);
+    vector<size_t> perm(n);
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = KeyT::encode(getKey(s[i]));
+        perm[i] = i;
+    }
+    _radixSortKeys(keys, &perm);
+
+    vector<T> sorted;
+    sorted.reserve(n);
+    for (size_t i : perm) {
+        sorted.push_back(move(s[i]));
+    }
+    move(sorted.begin(), sorted.end(), s.begin());
+}
+
+/*! Stable sort of a random-access sequence by `comp`. With a parallel
+ * policy, chunks are sorted on the policy's pool, then merged pairwise, with
+ * the merges of each round also run in parallel.
+ */
+template <class SeqT, class CompT=less<typename SeqT::value_type>>
+void mergeSort(const execution::Policy &policy, SeqT &s, const CompT &comp=CompT()) {
+    typedef typename SeqT::value_type T;
+
+    size_t n = s.size();
+    size_t chunkSize = policy.chunkSize(n);
+    auto begin = s.begin();
+    if (chunkSize >= n) {
+        stable_sort(begin, s.end(), comp);
+        return;
+    }
+
+    execution::_forChunks(policy, n, chunkSize, [&](size_t, size_t lo, size_t hi) {
+        stable_sort(begin + ptrdiff_t(lo), begin + ptrdiff_t(hi), comp);
+    });
+
+    // merge runs of `width` back and forth between `s` and `buf`
+    vector<T> buf(make_move_iterator(begin), make_move_iterator(s.end()));
+    bool inBuf = true;
+    for (size_t width = chunkSize; width < n; width *= 2) {
+        size_t nPairs = (n + 2 * width - 1) / (2 * width);
+        policy.getPool().parallelFor(0, nPairs, 1, [&](size_t pairI) {
+            size_t lo = pairI * 2 * width;
+            size_t mid = min(lo + width, n);
+            size_t hi = min(lo + 2 * width, n);
+            if (inBuf) {
+                merge(make_move_iterator(buf.begin() + ptrdiff_t(lo)),
+                      make_move_iterator(buf.begin() + ptrdiff_t(mid)),
+                      make_move_iterator(buf.begin() + ptrdiff_t(mid)),
+                      make_move_iterator(buf.begin() + ptrdiff_t(hi)),
+                      begin + ptrdiff_t(lo), comp);
+            } else {
+                merge(make_move_iterator(begin + ptrdiff_t(lo)),
+                      make_move_iterator(begin + ptrdiff_t(mid)),
+                      make_move_iterator(begin + ptrdiff_t(mid)),
+                      make_move_iterator(begin + ptrdiff_t(hi)),
+                      buf.begin() + ptrdiff_t(lo), comp);
+            }
+        });
+        inBuf = not inBuf;
+    }
+    if (inBuf) {
+        move(buf.begin(), buf.end(), begin);
+    }
+}
+
+/*! Stable sort of a random-access sequence by `comp`, on the default pool. */
+template <class SeqT, class CompT=less<typename SeqT::value_type>>
+functional::_IfNotPolicy<SeqT, void> mergeSort(SeqT &s, const CompT &comp=CompT()) {
+    mergeSort(execution::PAR, s, comp);
+}
+
+/*! Sort the `k` smallest elements (by `comp`) of a random-access sequence in
+ * order to its front, leaving the rest in unspecified order. `k` > `size()`
+ * sorts everything.
+ */
+template <class SeqT, class CompT=less<typename SeqT::value_type>>
+void partialSort(SeqT &s, size_t k, const CompT &comp=CompT()) {
+    k = min(k, s.size());
+    partial_sort(s.begin(), s.begin() + ptrdiff_t(k), s.end(), comp);
+}
+
+/*! Put the element that would be at index `i` if the sequence were sorted by
+ * `comp` there, with no greater elements before it and no smaller ones after
+ * it, and return a reference to it. Throw `out_of_range` if `i` >= `size()`.
+ */
+template <class SeqT, class CompT=less<typename SeqT::value_type>>
+typename SeqT::reference nthElement(SeqT &s, size_t i, const CompT &comp=CompT()) {
+    if (i >= s.size()) {
+        throw out_of_range("`i` must be < size()");
+    }
+    nth_element(s.begin(), s.begin() + ptrdiff_t(i), s.end(), comp);
+    return s[i];
+}
+
 /*! Split a sequence into clusters based on some distance metric.
  *
  * An item is added to a cluster if it is within `maxDist` from all other items
@@ -327,7 +2023,7 @@ void cluster(const InSeqT &items, const DistFuncT &getDist, float maxDist, OutSe
         bool added = false;
         for (auto &cluster : clusters) {
             if (functional::all(
-                    [&](typename InSeqT::reference cItem) {
+                    [&](typename InSeqT::const_reference cItem) {
                         return getDist(cItem, item) <= maxDist;
                     },
                     cluster
@@ -338,46 +2034,446 @@ void cluster(const InSeqT &items, const DistFuncT &getDist, float maxDist, OutSe
             }
         }
         if (not added) {
-            clusters.push_back(InSeqT{item});
+            clusters.push_back(typename OutSeqT::value_type{item});
         }
     }
 }
 
-} // namespace seq
+/*! How `clusterPoints` decides whether a point joins a cluster. */
+enum Linkage {
+    /*! Within the distance of every point in the cluster, like `cluster`. */
+    COMPLETE,
+    /*! Within the distance of any point in the cluster. */
+    SINGLE
+};
 
-/*! Multiply each element in a sequence by `e`. */
+/*! Uniform grid of square cells over a fixed set of points, stored as one
+ * array of point indices sorted by cell.
+ */
+class _PointGrid {
+public:
+    /*! Grid over the points (`xs[i]`, `ys[i]`), with cells at least
+     * `cellSize` wide, but no more cells than about 4 per point.
+     */
+    _PointGrid(const vector<double> &xs, const vector<double> &ys, double cellSize)
+            : minX(0), minY(0), cellSize(cellSize > 0 ? cellSize : 1), nCols(1), nRows(1) {
+        if (not xs.empty()) {
+            auto xRange = minmax_element(xs.begin(), xs.end());
+            auto yRange = minmax_element(ys.begin(), ys.end());
+            this->minX = *xRange.first;
+            this->minY = *yRange.first;
+            double width = *xRange.second - this->minX;
+            double height = *yRange.second - this->minY;
+            double maxCells = 4. * double(xs.size()) + 16;
+            while ((width / this->cellSize + 1) * (height / this->cellSize + 1) > maxCells) {
+                this->cellSize *= 2;
+            }
+            this->nCols = size_t(width / this->cellSize) + 1;
+            this->nRows = size_t(height / this->cellSize) + 1;
+        }
+
+        // counting sort of the points by cell
+        vector<size_t> cellOfPt(xs.size());
+        this->cellStart.assign(this->nCols * this->nRows + 1, 0);
+        for (size_t i = 0; i < xs.size(); i++) {
+            cellOfPt[i] = this->rowOf(ys[i]) * this->nCols + this->colOf(xs[i]);
+            this->cellStart[cellOfPt[i] + 1]++;
+        }
+        for (size_t c = 1; c < this->cellStart.size(); c++) {
+            this->cellStart[c] += this->cellStart[c - 1];
+        }
+        vector<size_t> fill(this->cellStart.begin(), this->cellStart.end() - 1);
+        this->ptIs.resize(xs.size());
+        for (size_t i = 0; i < xs.size(); i++) {
+            this->ptIs[fill[cellOfPt[i]]++] = i;
+        }
+    }
+
+    /*! Call `func(i)` for each point `i` in the cell of (`x`, `y`) and its 8
+     * neighbours, in increasing order of `i` within each cell.
+     */
+    template <class FuncT>
+    void forNear(double x, double y, const FuncT &func) const {
+        size_t col = this->colOf(x);
+        size_t row = this->rowOf(y);
+        size_t firstCol = col > 0 ? col - 1 : 0;
+        size_t lastCol = min(col + 1, this->nCols - 1);
+        for (size_t r = row > 0 ? row - 1 : 0; r <= min(row + 1, this->nRows - 1); r++) {
+            // the neighbouring cells of a row are contiguous
+            size_t end = this->cellStart[r * this->nCols + lastCol + 1];
+            for (size_t k = this->cellStart[r * this->nCols + firstCol]; k < end; k++) {
+                func(this->ptIs[k]);
+            }
+        }
+    }
+
+private:
+    double minX;
+    double minY;
+    double cellSize;
+    size_t nCols;
+    size_t nRows;
+    // points in cell `c` are `ptIs[cellStart[c]]`...`ptIs[cellStart[c + 1] - 1]`
+    vector<size_t> cellStart;
+    vector<size_t> ptIs;
+
+    size_t colOf(double x) const { return size_t((x - this->minX) / this->cellSize); }
+    size_t rowOf(double y) const { return size_t((y - this->minY) / this->cellSize); }
+};
+
+/*! Disjoint-set forest over `0..n-1`, with path halving and union by size. */
+class _DisjointSets {
+public:
+    explicit _DisjointSets(size_t n) : parent(n), setSize(n, 1) {
+        for (size_t i = 0; i < n; i++) {
+            this->parent[i] = i;
+        }
+    }
+
+    size_t find(size_t i) {
+        while (this->parent[i] != i) {
+            this->parent[i] = this->parent[this->parent[i]];
+            i = this->parent[i];
+        }
+        return i;
+    }
+
+    void join(size_t a, size_t b) {
+        a = this->find(a);
+        b = this->find(b);
+        if (a == b) {
+            return;
+        }
+        if (this->setSize[a] < this->setSize[b]) {
+            swap(a, b);
+        }
+        this->parent[b] = a;
+        this->setSize[a] += this->setSize[b];
+    }
+
+private:
+    vector<size_t> parent;
+    vector<size_t> setSize;
+};
+
+/*! Split a sequence of items with 2D positions into clusters of items at most
+ * `maxDist` apart (Euclidean).
+ *
+ * `getPos` should take an item and return something with `x` and `y` members,
+ * e.g. a `cv::Point`.
+ *
+ * With `COMPLETE` linkage, the result is the same as `cluster` with the
+ * Euclidean distance, but candidate clusters are looked up in a grid with
+ * cells of size `maxDist` instead of comparing against every cluster. With
+ * `SINGLE` linkage, clusters are the connected components of the "within
+ * `maxDist`" relation, in order of their first item.
+ */
 template <
-        class NumT,
-        class ElemT,
-        template <class U=ElemT, class Alloc=allocator<ElemT>> class SeqT
+        class InSeqT,
+        class OutSeqT,
+        class PosFuncT
         >
-SeqT<> &operator*=(SeqT<> &s, const NumT &e) {
-    for (auto &elem : s) {
-        elem *= e;
+void clusterPoints(const InSeqT &items, const PosFuncT &getPos, float maxDist, OutSeqT &clusters,
+                   Linkage linkage=COMPLETE) {
+    clusters.clear();
+
+    vector<double> xs, ys;
+    for (const auto &item : items) {
+        auto pos = getPos(item);
+        xs.push_back(double(pos.x));
+        ys.push_back(double(pos.y));
+    }
+    double maxDistSqrd = double(maxDist) * double(maxDist);
+    auto isNear = [&](size_t i, size_t j) {
+        double dx = xs[i] - xs[j];
+        double dy = ys[i] - ys[j];
+        return dx * dx + dy * dy <= maxDistSqrd;
+    };
+
+    _PointGrid grid(xs, ys, maxDist);
+
+    if (linkage == SINGLE) {
+        _DisjointSets sets(xs.size());
+        for (size_t i = 0; i < xs.size(); i++) {
+            grid.forNear(xs[i], ys[i], [&](size_t j) {
+                if (j < i and isNear(i, j)) {
+                    sets.join(i, j);
+                }
+            });
+        }
+
+        // number clusters by their first item; 0 means not numbered yet
+        vector<size_t> clusterOfRoot(xs.size());
+        size_t i = 0;
+        for (const auto &item : items) {
+            size_t &clusterI = clusterOfRoot[sets.find(i++)];
+            if (clusterI == 0) {
+                clusters.push_back(typename OutSeqT::value_type{item});
+                clusterI = clusters.size();
+            } else {
+                clusters[clusterI - 1].push_back(item);
+            }
+        }
+        return;
+    }
+
+    // cluster of each item seen so far
+    vector<size_t> clusterOf(xs.size());
+    // indices of the items in each cluster
+    vector<SmallVec<size_t, 8>> members;
+    // last item each cluster was a candidate for, to drop duplicates
+    vector<size_t> seenFor;
+    vector<size_t> candidates;
+    size_t i = 0;
+    for (const auto &item : items) {
+        // a cluster can only take the item if it has a member within
+        // `maxDist`, i.e. in a neighbouring cell
+        candidates.clear();
+        grid.forNear(xs[i], ys[i], [&](size_t j) {
+            if (j < i and seenFor[clusterOf[j]] != i) {
+                seenFor[clusterOf[j]] = i;
+                candidates.push_back(clusterOf[j]);
+            }
+        });
+        sort(candidates.begin(), candidates.end());
+
+        size_t chosen = clusters.size();
+        for (size_t c : candidates) {
+            if (functional::all([&](size_t j) { return isNear(i, j); }, members[c])) {
+                chosen = c;
+                break;
+            }
+        }
+        if (chosen == clusters.size()) {
+            clusters.push_back(typename OutSeqT::value_type{item});
+            members.push_back(SmallVec<size_t, 8>{i});
+            seenFor.push_back(i);
+        } else {
+            clusters[chosen].push_back(item);
+            members[chosen].push_back(i);
+        }
+        clusterOf[i] = chosen;
+        i++;
     }
-    return s;
 }
 
-/*! Return a new sequence with each element multiplied by `e`. */
-template <
-        class NumT,
-        class ElemT,
-        template <class U=ElemT, class Alloc=allocator<ElemT>> class SeqT
-        >
-SeqT<> operator*(const SeqT<> &s, NumT e) {
-    SeqT<> res(s);
-    return (res *= e);
+/*! Lazy element-wise arithmetic on sequences.
+ *
+ * The global `+`, `-`, `*` and `/` operators on sequences (and scalars) build
+ * expression objects instead of new sequences; the whole expression is then
+ * computed in one loop, without temporaries, when it's converted to a
+ * sequence or passed to `assign`. Intermediate results keep the type of the
+ * arithmetic (e.g. `vector<int>{3} * 0.5 * 2` is 3). Sequences need random
+ * access; for others, like `list`, `*` and `/` by a number still return a
+ * new sequence right away.
+ *
+ * Temporary sequences are moved into the expression, but named ones are
+ * only referenced and must outlive it. Beware `auto`: `auto y = v * 2;`
+ * makes `y` an unevaluated expression tracking `v`, not a new sequence, so
+ * spell out the result type instead.
+ */
+namespace expr {
+    /*! Whether `T` is a class template with an element type and
+     * `std::allocator`, like `vector`, `deque` or `list`.
+     */
+    template <class T>
+    struct _IsAllocSeq : false_type {};
+    template <class ElemT, template <class, class> class SeqT>
+    struct _IsAllocSeq<SeqT<ElemT, allocator<ElemT>>> : true_type {};
+
+    template <class T, class Enable=void>
+    struct _HasRandomAccess : false_type {};
+    template <class T>
+    struct _HasRandomAccess<T, typename enable_if<is_base_of<
+        random_access_iterator_tag,
+        typename iterator_traits<typename T::iterator>::iterator_category
+        >::value>::type> : true_type {};
+
+    /*! Whether `T` is a sequence the lazy operators apply to: an allocator
+     * sequence with random access, like `vector` or `deque`.
+     */
+    template <class T>
+    struct IsSeq : integral_constant<bool, _IsAllocSeq<T>::value and _HasRandomAccess<T>::value> {};
+
+    /*! Whether `T` is a sequence without random access, like `list`, which
+     * the `*` and `/` operators compute eagerly instead.
+     */
+    template <class T>
+    struct IsEagerSeq : integral_constant<bool, _IsAllocSeq<T>::value and not _HasRandomAccess<T>::value> {};
+
+    /*! Base of the expression types. */
+    struct Expr {};
+
+    /*! A sequence operand, referenced by default or held by value when
+     * `StoreT` is `SeqT` (for temporaries).
+     */
+    template <class SeqT, class StoreT=const SeqT &>
+    struct Terminal : Expr {
+        typedef SeqT seq_type;
+        typedef typename SeqT::value_type value_type;
+
+        StoreT s;
+
+        template <
+                class U,
+                class=typename enable_if<is_same<typename decay<U>::type, SeqT>::value>::type
+                >
+        explicit Terminal(U &&s) : s(forward<U>(s)) {}
+        size_t size() const { return this->s.size(); }
+        value_type operator[](size_t i) const { return this->s[i]; }
+    };
+
+    /*! A scalar operand, repeated as needed. */
+    template <class NumT>
+    struct Scalar : Expr {
+        typedef void seq_type;
+        typedef NumT value_type;
+
+        NumT v;
+
+        explicit Scalar(NumT v) : v(v) {}
+        size_t size() const { return SIZE_MAX; }
+        NumT operator[](size_t) const { return this->v; }
+    };
+
+    struct Add {
+        template <class T, class U>
+        static auto apply(T a, U b) -> decltype(a + b) { return a + b; }
+    };
+    struct Sub {
+        template <class T, class U>
+        static auto apply(T a, U b) -> decltype(a - b) { return a - b; }
+    };
+    struct Mul {
+        template <class T, class U>
+        static auto apply(T a, U b) -> decltype(a * b) { return a * b; }
+    };
+    struct Div {
+        template <class T, class U>
+        static auto apply(T a, U b) -> decltype(a / b) { return a / b; }
+    };
+
+    /*! `OpT` applied element-wise to two operands. Converts implicitly to the
+     * type of its leftmost sequence operand.
+     */
+    template <class L, class R, class OpT>
+    struct Binary : Expr {
+        typedef typename conditional<
+            is_void<typename L::seq_type>::value,
+            typename R::seq_type,
+            typename L::seq_type
+            >::type seq_type;
+        typedef decltype(OpT::apply(declval<typename L::value_type>(),
+                                    declval<typename R::value_type>())) value_type;
+
+        L l;
+        R r;
+
+        /*! Throw `invalid_argument` if both operands are sequences of
+         * different sizes.
+         */
+        Binary(L l, R r) : l(move(l)), r(move(r)) {
+            size_t nl = this->l.size(), nr = this->r.size();
+            if (nl != nr and nl != SIZE_MAX and nr != SIZE_MAX) {
+                throw invalid_argument("sequence operands must have the same size");
+            }
+        }
+
+        size_t size() const { return min(this->l.size(), this->r.size()); }
+        value_type operator[](size_t i) const { return OpT::apply(this->l[i], this->r[i]); }
+
+        /*! Compute all elements into `out`, resizing it. */
+        template <class OutSeqT>
+        void evalInto(OutSeqT &out) const {
+            typedef typename OutSeqT::value_type OutT;
+            size_t n = this->size();
+            out.resize(n);
+            for (size_t i = 0; i < n; i++) {
+                out[i] = OutT((*this)[i]);
+            }
+        }
+
+        operator seq_type() const {
+            seq_type out;
+            this->evalInto(out);
+            return out;
+        }
+
+        /*! Print like a sequence, i.e. as `[a, b, ...]`. */
+        friend ostream &operator<<(ostream &out, const Binary &e) {
+            out << "[";
+            for (size_t i = 0; i < e.size(); i++) {
+                out << (i == 0 ? "" : ", ") << e[i];
+            }
+            out << "]";
+            return out;
+        }
+    };
+
+    /*! Wrap an operator argument, forwarded as `T`, in its expression type.
+     * Sequences are referenced if `T` is an lvalue and moved in otherwise.
+     */
+    template <class T, class D=typename decay<T>::type, class Enable=void>
+    struct Wrap {
+        typedef Scalar<D> type;
+    };
+    template <class T, class D>
+    struct Wrap<T, D, typename enable_if<IsSeq<D>::value>::type> {
+        typedef typename conditional<
+            is_lvalue_reference<T>::value,
+            Terminal<D>,
+            Terminal<D, D>
+            >::type type;
+    };
+    template <class T, class D>
+    struct Wrap<T, D, typename enable_if<is_base_of<Expr, D>::value>::type> {
+        typedef D type;
+    };
+
+    template <class T>
+    struct IsOperand : integral_constant<bool, IsSeq<T>::value or is_base_of<Expr, T>::value> {};
+
+    /*! The expression type of `l` `OpT` `r`, if that is an element-wise
+     * operation: a sequence or expression with a sequence, an expression or
+     * a number. `L` and `R` are the forwarded argument types.
+     */
+    template <class L, class R, class OpT,
+              class DL=typename decay<L>::type, class DR=typename decay<R>::type>
+    struct BinaryOf : enable_if<
+        (IsOperand<DL>::value and (IsOperand<DR>::value or is_arithmetic<DR>::value)) or
+        (is_arithmetic<DL>::value and IsOperand<DR>::value),
+        Binary<typename Wrap<L>::type, typename Wrap<R>::type, OpT>
+        > {};
+
+    template <class OpT, class L, class R>
+    Binary<typename Wrap<L>::type, typename Wrap<R>::type, OpT> make(L &&l, R &&r) {
+        return Binary<typename Wrap<L>::type, typename Wrap<R>::type, OpT>(
+            typename Wrap<L>::type(forward<L>(l)), typename Wrap<R>::type(forward<R>(r)));
+    }
 }
 
-/*! Return a new sequence with each element multiplied by `e`. */
+/*! Evaluate the element-wise expression `e` into `out`, resizing it, and
+ * return `out`.
+ */
+template <class OutSeqT, class L, class R, class OpT>
+OutSeqT &assign(OutSeqT &out, const expr::Binary<L, R, OpT> &e) {
+    e.evalInto(out);
+    return out;
+}
+
+} // namespace seq
+
+/*! Multiply each element in a sequence by `e`. */
 template <
         class NumT,
         class ElemT,
         template <class U=ElemT, class Alloc=allocator<ElemT>> class SeqT
         >
-SeqT<> operator*(NumT e, const SeqT<> &s) {
-    SeqT<> res(s);
-    return (res *= e);
+SeqT<> &operator*=(SeqT<> &s, const NumT &e) {
+    for (auto &elem : s) {
+        elem *= e;
+    }
+    return s;
 }
 
 /*! Divide each element in a sequence by `e`. */
@@ -393,31 +2489,69 @@ SeqT<> &operator/=(SeqT<> &s, const NumT &e) {
     return s;
 }
 
+/*! Return a new sequence with each element multiplied by `e`, for
+ * sequences without random access. See `seq::expr` for the others.
+ */
+template <class SeqT, class NumT>
+typename enable_if<seq::expr::IsEagerSeq<SeqT>::value and is_arithmetic<NumT>::value, SeqT>::type
+operator*(const SeqT &s, NumT e) {
+    SeqT res(s);
+    return (res *= e);
+}
+
+/*! Return a new sequence with each element multiplied by `e`. */
+template <class NumT, class SeqT>
+typename enable_if<seq::expr::IsEagerSeq<SeqT>::value and is_arithmetic<NumT>::value, SeqT>::type
+operator*(NumT e, const SeqT &s) {
+    SeqT res(s);
+    return (res *= e);
+}
+
 /*! Return a new sequence with each element divided by `e`. */
-template <
-        class NumT,
-        class ElemT,
-        template <class U=ElemT, class Alloc=allocator<ElemT>> class SeqT
-        >
-SeqT<> operator/(const SeqT<> &s, NumT e) {
-    SeqT<> res(s);
+template <class SeqT, class NumT>
+typename enable_if<seq::expr::IsEagerSeq<SeqT>::value and is_arithmetic<NumT>::value, SeqT>::type
+operator/(const SeqT &s, NumT e) {
+    SeqT res(s);
     return (res /= e);
 }
 
-/*! Return a new sequence with each element divided by `e`. */
-template <
-        class NumT,
-        class ElemT,
-        template <class U=ElemT, class Alloc=allocator<ElemT>> class SeqT
-        >
-SeqT<> operator/(NumT e, const SeqT<ElemT> &s) {
-    SeqT<> res(s);
-    for (auto &n: res) {
+/*! Return a new sequence with `e` divided by each element. */
+template <class NumT, class SeqT>
+typename enable_if<seq::expr::IsEagerSeq<SeqT>::value and is_arithmetic<NumT>::value, SeqT>::type
+operator/(NumT e, const SeqT &s) {
+    SeqT res(s);
+    for (auto &n : res) {
         n = e / n;
     }
     return res;
 }
 
+/*! Return an expression adding `l` and `r` element-wise. See `seq::expr`:
+ * the result is not a sequence until converted, so don't bind it to `auto`.
+ */
+template <class L, class R>
+typename seq::expr::BinaryOf<L, R, seq::expr::Add>::type operator+(L &&l, R &&r) {
+    return seq::expr::make<seq::expr::Add>(forward<L>(l), forward<R>(r));
+}
+
+/*! Return an expression subtracting `r` from `l` element-wise. */
+template <class L, class R>
+typename seq::expr::BinaryOf<L, R, seq::expr::Sub>::type operator-(L &&l, R &&r) {
+    return seq::expr::make<seq::expr::Sub>(forward<L>(l), forward<R>(r));
+}
+
+/*! Return an expression multiplying `l` and `r` element-wise. */
+template <class L, class R>
+typename seq::expr::BinaryOf<L, R, seq::expr::Mul>::type operator*(L &&l, R &&r) {
+    return seq::expr::make<seq::expr::Mul>(forward<L>(l), forward<R>(r));
+}
+
+/*! Return an expression dividing `l` by `r` element-wise. */
+template <class L, class R>
+typename seq::expr::BinaryOf<L, R, seq::expr::Div>::type operator/(L &&l, R &&r) {
+    return seq::expr::make<seq::expr::Div>(forward<L>(l), forward<R>(r));
+}
+
 /*! Print each element of a container, surrounded by `[]` and separated by
  * commas.
  */
@@ -0,0 +1,672 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <climits>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "thr.hpp"
+
+using namespace std;
+using namespace thr;
+
+namespace {
+    // the pool and deque index of the current thread, if it is a worker
+    thread_local ThreadPool *curPool = NULL;
+    thread_local unsigned curWorker = 0;
+}
+
+/*** affinity ***/
+
+namespace {
+    /*! Parse a sysfs CPU list such as "0-3,8,10-11". */
+    vector<unsigned> parseCpuList(const string &list) {
+        vector<unsigned> cpus;
+        stringstream ss(list);
+        string range;
+        while (getline(ss, range, ',')) {
+            unsigned lo, hi;
+            char dash;
+            stringstream rs(range);
+            if (not (rs >> lo)) {
+                continue;
+            }
+            hi = lo;
+            if (rs >> dash >> hi and dash != '-') {
+                hi = lo;
+            }
+            for (unsigned cpu = lo; cpu <= hi; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+#ifdef __linux__
+    /*! Return `true` if `cpu` can be put in a `cpu_set_t`. */
+    bool pinnable(unsigned cpu) {
+        return cpu < unsigned(CPU_SETSIZE);
+    }
+#endif
+
+    /*! Return the ids of the online CPUs this process may run on, in
+     * ascending order. Ids need not be contiguous when CPUs are offline or
+     * isolated.
+     */
+    vector<unsigned> onlineCpus() {
+        vector<unsigned> cpus;
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool haveAllowed = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        ifstream onlineFile("/sys/devices/system/cpu/online");
+        string list;
+        if (getline(onlineFile, list)) {
+            for (unsigned cpu : parseCpuList(list)) {
+                if (pinnable(cpu) and (not haveAllowed or CPU_ISSET(cpu, &allowed))) {
+                    cpus.push_back(cpu);
+                }
+            }
+        } else if (haveAllowed) {
+            for (unsigned cpu = 0; cpu < unsigned(CPU_SETSIZE); cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+#endif
+        if (cpus.empty()) {
+            for (unsigned cpu = 0; cpu < max(thread::hardware_concurrency(), 1u); cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+
+    /*! Add the members of `cpus` found in `online` to `domains`, unless an
+     * identical domain is already there.
+     */
+    void addDomain(
+            vector<vector<unsigned>> &domains,
+            const vector<unsigned> &cpus,
+            const vector<unsigned> &online
+            ) {
+        vector<unsigned> domain;
+        for (unsigned cpu : cpus) {
+            if (binary_search(online.begin(), online.end(), cpu)) {
+                domain.push_back(cpu);
+            }
+        }
+        if (not domain.empty() and find(domains.begin(), domains.end(), domain) == domains.end()) {
+            domains.push_back(domain);
+        }
+    }
+}
+
+CpuTopology thr::CpuTopology::detect() {
+    CpuTopology topo;
+    vector<unsigned> online = onlineCpus();
+    sort(online.begin(), online.end());
+    topo.nCpus = unsigned(online.size());
+
+    for (unsigned cpu : online) {
+        bool foundL2 = false, foundL3 = false;
+        for (unsigned index = 0; ; index++) {
+            stringstream dir;
+            dir << "/sys/devices/system/cpu/cpu" << cpu << "/cache/index" << index << "/";
+            ifstream levelFile(dir.str() + "level");
+            ifstream listFile(dir.str() + "shared_cpu_list");
+            unsigned level;
+            string list;
+            if (not (levelFile >> level) or not getline(listFile, list)) {
+                break;
+            }
+            if (level == 2) {
+                addDomain(topo.l2Domains, parseCpuList(list), online);
+                foundL2 = true;
+            } else if (level == 3) {
+                addDomain(topo.l3Domains, parseCpuList(list), online);
+                foundL3 = true;
+            }
+        }
+        if (not foundL2) {
+            topo.l2Domains.push_back(vector<unsigned>{cpu});
+        }
+        if (not foundL3) {
+            topo.l3Domains.push_back(vector<unsigned>{cpu});
+        }
+    }
+    return topo;
+}
+
+vector<unsigned> thr::CpuTopology::order(Placement placement) const {
+    vector<unsigned> cpus;
+    if (placement == NO_PINNING) {
+        return cpus;
+    }
+
+    // group the L2 domains by the L3 domain holding them
+    vector<vector<vector<unsigned>>> groups(this->l3Domains.size());
+    for (auto &l2 : this->l2Domains) {
+        size_t g = 0;
+        while (g < this->l3Domains.size() and find(
+                    this->l3Domains[g].begin(), this->l3Domains[g].end(), l2.front()
+                    ) == this->l3Domains[g].end()) {
+            g++;
+        }
+        if (g == groups.size()) {
+            groups.push_back(vector<vector<unsigned>>());
+        }
+        groups[g].push_back(l2);
+    }
+
+    if (placement == COMPACT) {
+        for (auto &group : groups) {
+            for (auto &l2 : group) {
+                cpus.insert(cpus.end(), l2.begin(), l2.end());
+            }
+        }
+    } else {
+        // take one CPU at a time from each L3 domain in turn, cycling through
+        // its L2 domains
+        vector<vector<unsigned>> perGroup(groups.size());
+        for (size_t g = 0; g < groups.size(); g++) {
+            for (size_t i = 0; ; i++) {
+                bool any = false;
+                for (auto &l2 : groups[g]) {
+                    if (i < l2.size()) {
+                        perGroup[g].push_back(l2[i]);
+                        any = true;
+                    }
+                }
+                if (not any) {
+                    break;
+                }
+            }
+        }
+        for (size_t i = 0; cpus.size() < this->nCpus; i++) {
+            size_t before = cpus.size();
+            for (auto &group : perGroup) {
+                if (i < group.size()) {
+                    cpus.push_back(group[i]);
+                }
+            }
+            if (cpus.size() == before) {
+                break;
+            }
+        }
+    }
+    return cpus;
+}
+
+#ifdef __linux__
+namespace {
+    bool pinNative(pthread_t handle, const vector<unsigned> &cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned cpu : cpus) {
+            if (not pinnable(cpu)) {
+                return false;
+            }
+            CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(handle, sizeof(set), &set) == 0;
+    }
+}
+#endif
+
+bool thr::pinThread(const vector<unsigned> &cpus) {
+#ifdef __linux__
+    return pinNative(pthread_self(), cpus);
+#else
+    return false;
+#endif
+}
+
+bool thr::pinThread(thread &t, const vector<unsigned> &cpus) {
+#ifdef __linux__
+    return pinNative(t.native_handle(), cpus);
+#else
+    return false;
+#endif
+}
+
+bool thr::setThreadName(const string &name) {
+#if defined(__linux__)
+    return pthread_setname_np(pthread_self(), name.substr(0, 15).c_str()) == 0;
+#elif defined(__APPLE__)
+    return pthread_setname_np(name.c_str()) == 0;
+#else
+    return false;
+#endif
+}
+
+bool thr::setThreadName(thread &t, const string &name) {
+#ifdef __linux__
+    return pthread_setname_np(t.native_handle(), name.substr(0, 15).c_str()) == 0;
+#else
+    return false;
+#endif
+}
+
+/*** class `WorkDeque` ***/
+
+thr::WorkDeque::Array::Array(size_t capacity)
+: mask(capacity - 1), items(new atomic<PoolTask *>[capacity]) {
+}
+
+thr::WorkDeque::WorkDeque(size_t capacity)
+: top(0), bottom(0) {
+    this->arrays.emplace_back(new Array(capacity));
+    this->array.store(this->arrays.back().get(), memory_order_relaxed);
+}
+
+void thr::WorkDeque::push(PoolTask *task) {
+    long long b = this->bottom.load(memory_order_relaxed);
+    long long t = this->top.load(memory_order_acquire);
+    Array *a = this->array.load(memory_order_relaxed);
+
+    if (b - t > (long long)a->mask) {
+        // full, so grow into an array twice the size
+        Array *bigger = new Array(2 * (a->mask + 1));
+        for (long long i = t; i < b; i++) {
+            bigger->put(i, a->get(i));
+        }
+        this->arrays.emplace_back(bigger);
+        this->array.store(bigger, memory_order_release);
+        a = bigger;
+    }
+
+    a->put(b, task);
+    atomic_thread_fence(memory_order_release);
+    this->bottom.store(b + 1, memory_order_relaxed);
+}
+
+PoolTask *thr::WorkDeque::pop() {
+    long long b = this->bottom.load(memory_order_relaxed) - 1;
+    Array *a = this->array.load(memory_order_relaxed);
+    this->bottom.store(b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = this->top.load(memory_order_relaxed);
+
+    PoolTask *task = NULL;
+    if (t <= b) {
+        task = a->get(b);
+        if (t == b) {
+            // last item, so race against thieves for it
+            if (not this->top.compare_exchange_strong(
+                        t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+                task = NULL;
+            }
+            this->bottom.store(b + 1, memory_order_relaxed);
+        }
+    } else {
+        this->bottom.store(b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+PoolTask *thr::WorkDeque::steal() {
+    long long t = this->top.load(memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = this->bottom.load(memory_order_acquire);
+
+    if (t >= b) {
+        return NULL;
+    }
+    Array *a = this->array.load(memory_order_acquire);
+    PoolTask *task = a->get(t);
+    if (not this->top.compare_exchange_strong(
+                t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return task;
+}
+
+/*** class `ThreadPool` ***/
+
+thr::ThreadPool::ThreadPool(unsigned nThreads, Placement placement)
+: nQueued(0), nSleeping(0), stopping(false) {
+    nThreads = max(nThreads, 1u);
+    // reading the topology means several sysfs files per CPU, so skip it
+    // unless pinning
+    vector<unsigned> cpus;
+    if (placement != NO_PINNING) {
+        cpus = CpuTopology::detect().order(placement);
+    }
+    for (unsigned i = 0; i < nThreads; i++) {
+        this->deques.emplace_back(new WorkDeque());
+    }
+    for (unsigned i = 0; i < nThreads; i++) {
+        // UINT_MAX means "don't pin"
+        unsigned cpu = cpus.empty() ? UINT_MAX : cpus[i % cpus.size()];
+        this->workers.push_back(thread(&ThreadPool::_workerLoop, this, i, cpu));
+    }
+}
+
+thr::ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lk(this->sleepLock);
+        this->stopping.store(true);
+    }
+    this->wake.notify_all();
+    for (auto &worker : this->workers) {
+        worker.join();
+    }
+}
+
+void thr::ThreadPool::_enqueue(PoolTask *task) {
+    if (curPool == this) {
+        this->deques[curWorker]->push(task);
+    } else {
+        lock_guard<mutex> lk(this->injectLock);
+        this->injected.push_back(task);
+    }
+
+    this->nQueued.fetch_add(1);
+    if (this->nSleeping.load() != 0) {
+        lock_guard<mutex> lk(this->sleepLock);
+        this->wake.notify_one();
+    }
+}
+
+PoolTask *thr::ThreadPool::_findTask() {
+    PoolTask *task = NULL;
+    size_t n = this->deques.size();
+    size_t self = (curPool == this) ? curWorker : 0;
+
+    if (curPool == this) {
+        task = this->deques[self]->pop();
+    }
+    if (task == NULL) {
+        lock_guard<mutex> lk(this->injectLock);
+        if (not this->injected.empty()) {
+            task = this->injected.front();
+            this->injected.pop_front();
+        }
+    }
+    for (size_t i = 1; task == NULL and i <= n; i++) {
+        task = this->deques[(self + i) % n]->steal();
+    }
+
+    if (task != NULL) {
+        this->nQueued.fetch_sub(1);
+    }
+    return task;
+}
+
+void thr::ThreadPool::_workerLoop(unsigned i, unsigned cpu) {
+    curPool = this;
+    curWorker = i;
+
+    stringstream name;
+    name << "pool-" << i;
+    setThreadName(name.str());
+    if (cpu != UINT_MAX) {
+        pinThread(vector<unsigned>{cpu});
+    }
+
+    while (1) {
+        PoolTask *task = this->_findTask();
+        if (task != NULL) {
+            task->run();
+            continue;
+        }
+
+        unique_lock<mutex> lk(this->sleepLock);
+        if (this->stopping.load() and this->nQueued.load() == 0) {
+            break;
+        }
+        this->nSleeping.fetch_add(1);
+        this->wake.wait(lk, [&]() {
+            return this->stopping.load() or this->nQueued.load() > 0;
+        });
+        this->nSleeping.fetch_sub(1);
+    }
+}
+
+bool thr::ThreadPool::runPending() {
+    PoolTask *task = this->_findTask();
+    if (task == NULL) {
+        return false;
+    }
+    task->run();
+    return true;
+}
+
+ThreadPool &thr::defaultPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+/*** class `Scheduler` ***/
+
+thr::Scheduler::Scheduler(ThreadPool &pool, ClockT::duration tick)
+: pool(pool), tick(tick), startTime(ClockT::now()), curTick(0), nActive(0), stopping(false) {
+    for (auto &level : this->wheel) {
+        for (auto &slot : level) {
+            slot = NULL;
+        }
+    }
+    this->driver = thread(&Scheduler::_run, this);
+}
+
+thr::Scheduler::~Scheduler() {
+    {
+        lock_guard<mutex> lk(this->lock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    this->driver.join();
+
+    // the pool still holds pointers to timers whose runs haven't finished
+    for (auto &t : this->timers) {
+        while (t->inFlight.load(memory_order_acquire)) {
+            if (not this->pool.runPending()) {
+                this_thread::yield();
+            }
+        }
+    }
+}
+
+Scheduler::TaskId thr::Scheduler::_add(ClockT::duration delay, ClockT::duration period, const Task &task) {
+    lock_guard<mutex> lk(this->lock);
+
+    size_t i;
+    // a freed timer can't be reused until its last run has finished
+    if (this->freeTimers.empty() or
+            this->timers[this->freeTimers.back()]->inFlight.load(memory_order_acquire)) {
+        i = this->timers.size();
+        this->timers.emplace_back(new Timer());
+        this->timers.back()->gen = 0;
+        this->timers.back()->i = i;
+        this->freeTimers.reserve(this->timers.size());
+    } else {
+        i = this->freeTimers.back();
+        this->freeTimers.pop_back();
+    }
+    Timer *t = this->timers[i].get();
+
+    // round the delay up to whole ticks, counted from real time rather than
+    // `curTick` in case the driver is lagging
+    long long nowTicks = (ClockT::now() - this->startTime) / this->tick;
+    long long delayTicks = (delay + this->tick - ClockT::duration(1)) / this->tick;
+    if (this->nActive == 0) {
+        // the wheel is empty, so skip the ticks the driver slept through
+        this->curTick = max(this->curTick, (unsigned long long)nowTicks);
+    }
+    t->task = task;
+    t->expiry = max(this->curTick + 1, (unsigned long long)max(nowTicks + delayTicks, 0ll));
+    // round up, so a period that isn't a whole number of ticks never runs
+    // early, and keep periodic timers periodic
+    long long periodTicks = (period + this->tick - ClockT::duration(1)) / this->tick;
+    t->period = period <= ClockT::duration::zero() ? 0 : (unsigned long long)max(periodTicks, 1ll);
+    t->active = true;
+
+    this->_insert(t);
+    this->nActive++;
+    this->wake.notify_one();
+    return TaskId{i, t->gen};
+}
+
+void thr::Scheduler::_insert(Timer *t) {
+    // the level is the highest group of bits in which the expiry differs from
+    // the current tick, so the slot is reached (and cascaded down) before the
+    // timer is due
+    unsigned long long diff = t->expiry ^ this->curTick;
+    unsigned level = 0;
+    while (level + 1 < N_LEVELS and (diff >> SLOT_BITS) != 0) {
+        diff >>= SLOT_BITS;
+        level++;
+    }
+
+    unsigned slot;
+    if ((diff >> SLOT_BITS) != 0) {
+        // beyond the wheel's range: park it in the slot visited last and
+        // re-sort it then
+        slot = unsigned((this->curTick >> (SLOT_BITS * level)) + N_SLOTS - 1) & (N_SLOTS - 1);
+    } else {
+        slot = unsigned(t->expiry >> (SLOT_BITS * level)) & (N_SLOTS - 1);
+    }
+
+    Timer *&head = this->wheel[level][slot];
+    t->level = level;
+    t->slot = slot;
+    t->prev = NULL;
+    t->next = head;
+    if (head != NULL) {
+        head->prev = t;
+    }
+    head = t;
+}
+
+void thr::Scheduler::_unlink(Timer *t) {
+    if (t->prev != NULL) {
+        t->prev->next = t->next;
+    } else {
+        this->wheel[t->level][t->slot] = t->next;
+    }
+    if (t->next != NULL) {
+        t->next->prev = t->prev;
+    }
+}
+
+void thr::Scheduler::_free(Timer *t) {
+    t->active = false;
+    t->gen++;
+    // a run still in flight is using the task; it's replaced on reuse instead
+    if (not t->inFlight.load(memory_order_acquire)) {
+        t->task = Task();
+    }
+    this->nActive--;
+    this->freeTimers.push_back(t->i);
+}
+
+void thr::Scheduler::_advance() {
+    this->curTick++;
+
+    // cascade timers from higher levels whose slot just came up; they are
+    // now close enough to move down
+    for (unsigned level = 1; level < N_LEVELS; level++) {
+        if ((this->curTick & ((1ull << (SLOT_BITS * level)) - 1)) != 0) {
+            break;
+        }
+        unsigned slot = unsigned(this->curTick >> (SLOT_BITS * level)) & (N_SLOTS - 1);
+        Timer *t = this->wheel[level][slot];
+        this->wheel[level][slot] = NULL;
+        while (t != NULL) {
+            Timer *next = t->next;
+            this->_insert(t);
+            t = next;
+        }
+    }
+
+    unsigned slot = unsigned(this->curTick) & (N_SLOTS - 1);
+    Timer *t = this->wheel[0][slot];
+    this->wheel[0][slot] = NULL;
+    while (t != NULL) {
+        Timer *next = t->next;
+        if (not t->inFlight.load(memory_order_acquire)) {
+            t->inFlight.store(true, memory_order_relaxed);
+            this->pool.post(*t);
+        }
+        if (t->period != 0) {
+            t->expiry = max(t->expiry + t->period, this->curTick + 1);
+            this->_insert(t);
+        } else {
+            this->_free(t);
+        }
+        t = next;
+    }
+}
+
+void thr::Scheduler::_run() {
+    unique_lock<mutex> lk(this->lock);
+    while (not this->stopping) {
+        long long nowTicks = (ClockT::now() - this->startTime) / this->tick;
+        while ((long long)this->curTick < nowTicks) {
+            this->_advance();
+        }
+
+        if (this->nActive == 0) {
+            this->wake.wait(lk);
+        } else {
+            this->wake.wait_until(lk, this->startTime + this->tick * (this->curTick + 1));
+        }
+    }
+}
+
+bool thr::Scheduler::cancel(TaskId id) {
+    lock_guard<mutex> lk(this->lock);
+    if (id.i >= this->timers.size()) {
+        return false;
+    }
+    Timer *t = this->timers[id.i].get();
+    if (not t->active or t->gen != id.gen) {
+        return false;
+    }
+    this->_unlink(t);
+    this->_free(t);
+    return true;
+}
+
+size_t thr::Scheduler::size() {
+    lock_guard<mutex> lk(this->lock);
+    return this->nActive;
+}
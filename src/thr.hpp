@@ -26,48 +26,1600 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 /*! Multi-threading utilities. */
 namespace thr {
-    /*! Producer-consumer queue. */
-    template <typename T>
-    struct Queue {
-        static mutex lock;
+    /*! What a bounded `Queue` does with a new item when it is full. */
+    enum OverflowPolicy {
+        /*! Block the producer until there is room (back-pressure). */
+        BLOCK,
+        /*! Discard the new item. */
+        DROP_NEWEST,
+        /*! Discard the oldest queued item to make room. */
+        DROP_OLDEST
+    };
+
+    /*! Number of buckets in the timing histograms of `QueueStats`. */
+    const size_t N_HIST_BUCKETS = 32;
+
+    /*! Snapshot of a queue's instrumentation counters.
+     *
+     * Counters are only collected by queues instantiated with a
+     * `StatsRecorder` (e.g. `Queue<T, StatsRecorder>`); with the default
+     * `NoStats` they are compiled out entirely, take no space, and every
+     * snapshot is all zeros.
+     *
+     * Bucket `i` of a histogram counts durations in [2^i, 2^(i+1))
+     * nanoseconds (bucket 0 also holds 0 ns, the last bucket everything
+     * longer).
+     */
+    struct QueueStats {
+        unsigned long pushes;
+        unsigned long pops;
+        /*! Largest number of items ever queued at once. */
+        size_t highWater;
+        /*! Time spent waiting to acquire the queue's lock. */
+        unsigned long lockWaitHist[N_HIST_BUCKETS];
+        /*! Time items spent in the queue between push and pop. */
+        unsigned long queueTimeHist[N_HIST_BUCKETS];
+    };
+
+    /*! Collects the counters behind `QueueStats`, when passed as a queue's
+     * `StatsT`. Push timestamps are kept in order, so enqueued()/dequeued()
+     * must be called under the queue's lock.
+     */
+    class StatsRecorder {
+    private:
+        typedef chrono::steady_clock::time_point TimePoint;
+
+        atomic<unsigned long> pushes;
+        atomic<unsigned long> pops;
+        atomic<size_t> highWater;
+        atomic<unsigned long> lockWaitHist[N_HIST_BUCKETS];
+        atomic<unsigned long> queueTimeHist[N_HIST_BUCKETS];
+        deque<TimePoint> pushTimes;
+
+        static void _record(atomic<unsigned long> *hist, TimePoint start) {
+            long long ns = chrono::duration_cast<chrono::nanoseconds>(
+                    chrono::steady_clock::now() - start
+                    ).count();
+            size_t i = 0;
+            while (ns > 1 and i + 1 < N_HIST_BUCKETS) {
+                ns >>= 1;
+                i++;
+            }
+            hist[i].fetch_add(1, memory_order_relaxed);
+        }
+
+    public:
+        StatsRecorder() : pushes(0), pops(0), highWater(0) {
+            for (size_t i = 0; i < N_HIST_BUCKETS; i++) {
+                this->lockWaitHist[i].store(0, memory_order_relaxed);
+                this->queueTimeHist[i].store(0, memory_order_relaxed);
+            }
+        }
+
+        TimePoint now() const {
+            return chrono::steady_clock::now();
+        }
+
+        void lockAcquired(TimePoint start) {
+            _record(this->lockWaitHist, start);
+        }
+
+        void pushed(size_t depth, unsigned long n=1) {
+            this->pushes.fetch_add(n, memory_order_relaxed);
+            size_t prev = this->highWater.load(memory_order_relaxed);
+            while (depth > prev and not this->highWater.compare_exchange_weak(
+                        prev, depth, memory_order_relaxed));
+        }
+
+        void popped(unsigned long n=1) {
+            this->pops.fetch_add(n, memory_order_relaxed);
+        }
+
+        void enqueued() {
+            this->pushTimes.push_front(this->now());
+        }
+
+        void dequeued() {
+            _record(this->queueTimeHist, this->pushTimes.back());
+            this->pushTimes.pop_back();
+        }
+
+        void dropped() {
+            this->pushTimes.pop_back();
+        }
+
+        QueueStats snapshot() const {
+            QueueStats res = QueueStats();
+            res.pushes = this->pushes.load(memory_order_relaxed);
+            res.pops = this->pops.load(memory_order_relaxed);
+            res.highWater = this->highWater.load(memory_order_relaxed);
+            for (size_t i = 0; i < N_HIST_BUCKETS; i++) {
+                res.lockWaitHist[i] = this->lockWaitHist[i].load(memory_order_relaxed);
+                res.queueTimeHist[i] = this->queueTimeHist[i].load(memory_order_relaxed);
+            }
+            return res;
+        }
+    };
+
+    /*! Default `StatsT` of the queues: an empty no-op recorder, inherited
+     * from so it compiles away without taking space.
+     */
+    struct NoStats {
+        int now() const { return 0; }
+        void lockAcquired(int) {}
+        void pushed(size_t, unsigned long=1) {}
+        void popped(unsigned long=1) {}
+        void enqueued() {}
+        void dequeued() {}
+        void dropped() {}
+        QueueStats snapshot() const { return QueueStats(); }
+    };
+
+    /*! Producer-consumer queue.
+     *
+     * Consumers block on a condition variable instead of spinning, and
+     * producers block while a bounded queue is full. `close()` wakes everyone
+     * up so pipeline stages can shut down cleanly.
+     *
+     * Pass `StatsRecorder` as `StatsT` to collect `QueueStats` (likewise for
+     * `RingQueue` and `SPSCQueue`).
+     */
+    template <typename T, typename StatsT=NoStats>
+    struct Queue : private StatsT {
+        mutex lock;
+        condition_variable notEmpty;
+        condition_variable notFull;
 
         deque<T> q;
+        /*! Maximum number of items held at once, or 0 for no limit. */
+        size_t capacity;
+        /*! What push() does when the queue is full. */
+        OverflowPolicy policy;
+        /*! Number of items discarded by `policy`. */
+        unsigned long dropped;
+        bool closed;
 
-        Queue() {};
+        Queue(size_t capacity=0, OverflowPolicy policy=BLOCK)
+        : capacity(capacity), policy(policy), dropped(0), closed(false) {};
+
+        Queue(const Queue &) = delete;
+        Queue &operator=(const Queue &) = delete;
 
         /*! Return `true` if next item in queue was stored in `out` or `false`
          * if there was no item.
          */
         bool poll(T &out) {
-            lock_guard<mutex> lk(lock);
-            bool found = false;
-            if (not q.empty()) {
-                out = q.back();
+            unique_lock<mutex> lk(_acquire());
+            if (q.empty()) {
+                return false;
+            }
+            _pop(out, lk);
+            return true;
+        }
+
+        /*! Block until next item is stored in `out`. Return `false` without
+         * storing anything if the queue was closed and has been drained.
+         */
+        bool wait(T &out) {
+            unique_lock<mutex> lk(_acquire());
+            notEmpty.wait(lk, [&]() { return closed or not q.empty(); });
+            if (q.empty()) {
+                return false;
+            }
+            _pop(out, lk);
+            return true;
+        }
+
+        /*! Like wait(), but give up and return `false` after `timeout`. */
+        template <class Rep, class Period>
+        bool waitFor(T &out, const chrono::duration<Rep, Period> &timeout) {
+            unique_lock<mutex> lk(_acquire());
+            if (not notEmpty.wait_for(lk, timeout, [&]() { return closed or not q.empty(); })
+                    or q.empty()) {
+                return false;
+            }
+            _pop(out, lk);
+            return true;
+        }
+
+        /*! Push a new item into the queue. If it is full, block or drop an
+         * item according to `policy`. Return `false` if the queue was closed
+         * and the item was discarded.
+         */
+        bool push(const T &in) {
+            return _pushBlocking(in);
+        }
+
+        /*! Like push(const T &), but move `in` into the queue. `in` is left
+         * untouched if it was discarded.
+         */
+        bool push(T &&in) {
+            return _pushBlocking(move(in));
+        }
+
+        /*! Push a new item if there is room and return `true`, or return
+         * `false` if the queue is full or closed.
+         */
+        bool tryPush(const T &in) {
+            return _tryPush(in);
+        }
+
+        /*! Like tryPush(const T &), but move `in` into the queue. `in` is left
+         * untouched if `false` is returned.
+         */
+        bool tryPush(T &&in) {
+            return _tryPush(move(in));
+        }
+
+        /*! Stop accepting new items and wake all blocked producers and
+         * consumers. Items already queued can still be taken.
+         */
+        void close() {
+            {
+                unique_lock<mutex> lk(_acquire());
+                closed = true;
+            }
+            notEmpty.notify_all();
+            notFull.notify_all();
+        }
+
+        /*! Return the number of items currently queued. */
+        size_t size() {
+            unique_lock<mutex> lk(_acquire());
+            return q.size();
+        }
+
+        /*! Return a snapshot of the instrumentation counters. */
+        QueueStats stats() {
+            unique_lock<mutex> lk(lock);
+            return _stats().snapshot();
+        }
+
+        StatsT &_stats() {
+            return *this;
+        }
+
+        unique_lock<mutex> _acquire() {
+            auto start = _stats().now();
+            unique_lock<mutex> lk(lock);
+            _stats().lockAcquired(start);
+            return lk;
+        }
+
+        template <typename U>
+        bool _pushBlocking(U &&in) {
+            unique_lock<mutex> lk(_acquire());
+            if (policy == BLOCK) {
+                notFull.wait(lk, [&]() { return closed or not _full(); });
+            }
+            if (closed) {
+                return false;
+            }
+            if (_full()) {
+                dropped++;
+                if (policy == DROP_NEWEST) {
+                    return true;
+                }
                 q.pop_back();
-                found = true;
+                _stats().dropped();
+            }
+            _push(forward<U>(in));
+            lk.unlock();
+            notEmpty.notify_one();
+            return true;
+        }
+
+        template <typename U>
+        bool _tryPush(U &&in) {
+            unique_lock<mutex> lk(_acquire());
+            if (closed or _full()) {
+                return false;
+            }
+            _push(forward<U>(in));
+            lk.unlock();
+            notEmpty.notify_one();
+            return true;
+        }
+
+        template <typename U>
+        void _push(U &&in) {
+            q.push_front(forward<U>(in));
+            _stats().pushed(q.size());
+            _stats().enqueued();
+        }
+
+        bool _full() const {
+            return capacity != 0 and q.size() >= capacity;
+        }
+
+        void _pop(T &out, unique_lock<mutex> &lk) {
+            out = move(q.back());
+            q.pop_back();
+            _stats().popped();
+            _stats().dequeued();
+            lk.unlock();
+            notFull.notify_one();
+        }
+    };
+
+    /*! Size in bytes of a cache line, used to pad shared counters so they
+     * don't falsely share a line.
+     */
+    const size_t CACHE_LINE_SIZE = 64;
+
+    /*! Bounded lock-free multi-producer/multi-consumer queue.
+     *
+     * Has the same `push()`/`poll()`/`wait()` interface as `Queue`, but holds
+     * at most `capacity()` items in a fixed ring of slots, so pushing never
+     * allocates and unrelated queues never contend on a shared lock.
+     *
+     * Each slot carries a sequence number telling producers and consumers
+     * whether it is free for the current lap around the ring (see Dmitry
+     * Vyukov's bounded MPMC queue).
+     */
+    template <typename T, typename StatsT=NoStats>
+    class RingQueue : private StatsT {
+    private:
+        struct Slot {
+            atomic<size_t> seq;
+            T data;
+        };
+
+        unique_ptr<Slot[]> slots;
+        size_t mask;
+
+        char _pad0[CACHE_LINE_SIZE];
+        atomic<size_t> head;
+        char _pad1[CACHE_LINE_SIZE - sizeof(atomic<size_t>)];
+        atomic<size_t> tail;
+        char _pad2[CACHE_LINE_SIZE - sizeof(atomic<size_t>)];
+
+        StatsT &_stats() {
+            return *this;
+        }
+
+        const StatsT &_stats() const {
+            return *this;
+        }
+
+    public:
+        /*! `capacity` is the maximum number of items held at once.
+         *
+         * @throws invalid_argument
+         * Thrown if `capacity` is not a power of two.
+         */
+        RingQueue(size_t capacity)
+        : slots(new Slot[capacity]), mask(capacity - 1), head(0), tail(0) {
+            if (capacity < 2 or (capacity & mask) != 0) {
+                throw invalid_argument("`capacity` must be a power of two >= 2");
+            }
+            for (size_t i = 0; i < capacity; i++) {
+                this->slots[i].seq.store(i, memory_order_relaxed);
+            }
+        }
+
+        RingQueue(const RingQueue &) = delete;
+        RingQueue &operator=(const RingQueue &) = delete;
+
+        /*! Return the maximum number of items the queue can hold. */
+        size_t capacity() const {
+            return this->mask + 1;
+        }
+
+        /*! Return `true` if `in` was pushed or `false` if the queue was full.
+         */
+        bool tryPush(const T &in) {
+            size_t pos = this->tail.load(memory_order_relaxed);
+            while (1) {
+                Slot &slot = this->slots[pos & this->mask];
+                size_t seq = slot.seq.load(memory_order_acquire);
+                ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+                if (diff == 0) {
+                    if (this->tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                        slot.data = in;
+                        // read `head` while slot `pos` is still unpublished so
+                        // consumers can't have moved past it yet
+                        size_t h = this->head.load(memory_order_relaxed);
+                        slot.seq.store(pos + 1, memory_order_release);
+                        this->_stats().pushed(min(this->capacity(), pos + 1 - min(h, pos)));
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = this->tail.load(memory_order_relaxed);
+                }
+            }
+        }
+
+        /*! Push a new item into the queue, yielding while it is full. */
+        void push(const T &in) {
+            while (not tryPush(in)) {
+                this_thread::yield();
+            }
+        }
+
+        /*! Return `true` if next item in queue was stored in `out` or `false`
+         * if there was no item.
+         */
+        bool poll(T &out) {
+            size_t pos = this->head.load(memory_order_relaxed);
+            while (1) {
+                Slot &slot = this->slots[pos & this->mask];
+                size_t seq = slot.seq.load(memory_order_acquire);
+                ptrdiff_t diff = ptrdiff_t(seq) - ptrdiff_t(pos + 1);
+                if (diff == 0) {
+                    if (this->head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                        out = move(slot.data);
+                        slot.seq.store(pos + this->mask + 1, memory_order_release);
+                        this->_stats().popped();
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = this->head.load(memory_order_relaxed);
+                }
             }
-            return found;
         }
 
         /*! Block until next item is stored in `out`. */
         void wait(T &out) {
-            while (not poll(out));
+            while (not poll(out)) {
+                this_thread::yield();
+            }
         }
 
-        /*! Push a new item into the queue. */
+        /*! Return a snapshot of the instrumentation counters (there is no
+         * lock, so only counts and the high-water mark are collected).
+         */
+        QueueStats stats() const {
+            return this->_stats().snapshot();
+        }
+    };
+
+    /*! Bounded wait-free queue for exactly one producer thread and one
+     * consumer thread, such as the hand-off from a camera thread to the hand
+     * tracker.
+     *
+     * Each index is written by only one side, so every operation is a couple
+     * of acquire/release loads and stores. Items are moved in and out, so for
+     * `cv::Mat` only the header is transferred, never the pixels.
+     *
+     * Suggested usage:
+     *
+     *      thr::SPSCQueue<cv::Mat> frames(4);
+     *
+     *      // camera thread
+     *      cv::Mat frame;
+     *      reader >> frame;
+     *      frames.push(move(frame));
+     *
+     *      // tracker thread
+     *      cv::Mat frame;
+     *      frames.wait(frame);
+     */
+    template <typename T, typename StatsT=NoStats>
+    class SPSCQueue : private StatsT {
+    private:
+        unique_ptr<T[]> slots;
+        size_t mask;
+
+        // each side's index shares a line with its cache of the other side's
+        // index, so the only cross-core traffic is the occasional refresh
+        char _pad0[CACHE_LINE_SIZE];
+        // written by the producer
+        atomic<size_t> tail;
+        // producer's last observed value of `head`
+        size_t headCache;
+        char _pad1[CACHE_LINE_SIZE - sizeof(atomic<size_t>) - sizeof(size_t)];
+        // written by the consumer
+        atomic<size_t> head;
+        // consumer's last observed value of `tail`
+        size_t tailCache;
+        char _pad2[CACHE_LINE_SIZE - sizeof(atomic<size_t>) - sizeof(size_t)];
+
+        StatsT &_stats() {
+            return *this;
+        }
+
+        const StatsT &_stats() const {
+            return *this;
+        }
+
+        /*! Return the number of free slots as seen by the producer, only
+         * re-reading `head` if the cached value shows fewer than `wanted`.
+         */
+        size_t _freeSlots(size_t t, size_t wanted) {
+            size_t free = this->mask + 1 - (t - this->headCache);
+            if (free < wanted) {
+                this->headCache = this->head.load(memory_order_acquire);
+                free = this->mask + 1 - (t - this->headCache);
+            }
+            return free;
+        }
+
+        /*! Return the number of filled slots as seen by the consumer, only
+         * re-reading `tail` if the cached value shows fewer than `wanted`.
+         */
+        size_t _filledSlots(size_t h, size_t wanted) {
+            size_t filled = this->tailCache - h;
+            if (filled < wanted) {
+                this->tailCache = this->tail.load(memory_order_acquire);
+                filled = this->tailCache - h;
+            }
+            return filled;
+        }
+
+    public:
+        /*! `capacity` is the maximum number of items held at once.
+         *
+         * @throws invalid_argument
+         * Thrown if `capacity` is not a power of two.
+         */
+        SPSCQueue(size_t capacity)
+        : slots(new T[capacity]), mask(capacity - 1), tail(0), headCache(0), head(0), tailCache(0) {
+            if (capacity < 2 or (capacity & mask) != 0) {
+                throw invalid_argument("`capacity` must be a power of two >= 2");
+            }
+        }
+
+        SPSCQueue(const SPSCQueue &) = delete;
+        SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+        /*! Return the maximum number of items the queue can hold. */
+        size_t capacity() const {
+            return this->mask + 1;
+        }
+
+        /*! Move `in` into the queue and return `true`, or return `false`
+         * (leaving `in` untouched) if the queue is full. Producer only.
+         */
+        bool tryPush(T &&in) {
+            size_t t = this->tail.load(memory_order_relaxed);
+            if (_freeSlots(t, 1) == 0) {
+                return false;
+            }
+            this->slots[t & this->mask] = move(in);
+            this->tail.store(t + 1, memory_order_release);
+            this->_stats().pushed(t + 1 - this->headCache);
+            return true;
+        }
+
+        /*! Move `in` into the queue, yielding while it is full. Producer only.
+         */
+        void push(T &&in) {
+            while (not tryPush(move(in))) {
+                this_thread::yield();
+            }
+        }
+
+        /*! Move as many of the `n` items at `in` into the queue as there is
+         * room for, and return how many were moved. Producer only.
+         */
+        size_t pushN(T *in, size_t n) {
+            size_t t = this->tail.load(memory_order_relaxed);
+            n = min(n, _freeSlots(t, n));
+            for (size_t i = 0; i < n; i++) {
+                this->slots[(t + i) & this->mask] = move(in[i]);
+            }
+            this->tail.store(t + n, memory_order_release);
+            this->_stats().pushed(t + n - this->headCache, n);
+            return n;
+        }
+
+        /*! Return `true` if next item in queue was moved into `out` or `false`
+         * if there was no item. Consumer only.
+         */
+        bool poll(T &out) {
+            size_t h = this->head.load(memory_order_relaxed);
+            if (_filledSlots(h, 1) == 0) {
+                return false;
+            }
+            out = move(this->slots[h & this->mask]);
+            this->head.store(h + 1, memory_order_release);
+            this->_stats().popped();
+            return true;
+        }
+
+        /*! Block until next item is moved into `out`. Consumer only. */
+        void wait(T &out) {
+            while (not poll(out)) {
+                this_thread::yield();
+            }
+        }
+
+        /*! Move up to `n` items from the queue into `out` and return how many
+         * were moved. Consumer only.
+         */
+        size_t popN(T *out, size_t n) {
+            size_t h = this->head.load(memory_order_relaxed);
+            n = min(n, _filledSlots(h, n));
+            for (size_t i = 0; i < n; i++) {
+                out[i] = move(this->slots[(h + i) & this->mask]);
+            }
+            this->head.store(h + n, memory_order_release);
+            this->_stats().popped(n);
+            return n;
+        }
+
+        /*! Return a snapshot of the instrumentation counters (only counts
+         * and an approximate high-water mark are collected).
+         */
+        QueueStats stats() const {
+            return this->_stats().snapshot();
+        }
+    };
+
+    /*! Single-producer/single-consumer "latest value" slot (a triple buffer).
+     *
+     * The producer always overwrites the newest item and the consumer always
+     * picks up the most recent one, so a slow consumer skips stale items
+     * instead of falling further and further behind. Items are handed over by
+     * swapping buffers, never by copying. poll() and wait() hand the consumer
+     * its own buffer; update() and latest() recycle buffers to avoid
+     * allocating (see update()).
+     *
+     * Suggested usage, capping camera-to-cursor latency at one frame:
+     *
+     *      thr::Mailbox<cv::Mat> frames;
+     *
+     *      // camera thread
+     *      while (1) {
+     *          reader >> frames;
+     *      }
+     *
+     *      // tracker thread
+     *      cv::Mat frame;
+     *      while (1) {
+     *          frames.wait(frame);
+     *          finder.getMouseState(frame, state);
+     *      }
+     */
+    template <typename T>
+    class Mailbox {
+    private:
+        // set in `middle` when it holds an item the consumer hasn't seen yet
+        static const unsigned FRESH = 4;
+
+        T bufs[3];
+
+        char _padBufs[CACHE_LINE_SIZE];
+        // index of the buffer being handed over, OR'd with `FRESH`
+        atomic<unsigned> middle;
+        char _pad0[CACHE_LINE_SIZE - sizeof(atomic<unsigned>)];
+        // index of the buffer owned by the producer
+        unsigned back;
+        atomic<unsigned long> nPublished;
+        atomic<unsigned long> nDropped;
+        char _pad1[CACHE_LINE_SIZE];
+        // index of the buffer owned by the consumer
+        unsigned front;
+
+    public:
+        Mailbox() : middle(1), back(0), nPublished(0), nDropped(0), front(2) {}
+
+        Mailbox(const Mailbox &) = delete;
+        Mailbox &operator=(const Mailbox &) = delete;
+
+        /*! Return the buffer the producer should fill before calling
+         * publish(). Producer only.
+         */
+        T &writeSlot() {
+            return this->bufs[this->back];
+        }
+
+        /*! Make the contents of writeSlot() the latest item. If the previous
+         * item was never picked up it is dropped. Producer only.
+         */
+        void publish() {
+            unsigned old = this->middle.exchange(this->back | FRESH, memory_order_acq_rel);
+            if (old & FRESH) {
+                this->nDropped.fetch_add(1, memory_order_relaxed);
+            }
+            this->nPublished.fetch_add(1, memory_order_relaxed);
+            this->back = old & ~FRESH;
+        }
+
+        /*! Move `in` into writeSlot() and publish it. Producer only. */
+        void push(T &&in) {
+            this->writeSlot() = move(in);
+            this->publish();
+        }
+
+        /*! Copy `in` into writeSlot() and publish it. Producer only. */
         void push(const T &in) {
-            lock_guard<mutex> lk(lock);
-            q.push_front(in);
+            this->writeSlot() = in;
+            this->publish();
+        }
+
+        /*! Take ownership of the latest item if there is a new one and return
+         * `true`, else return `false`. The item is then available from
+         * latest(). Consumer only.
+         *
+         * The previous latest() buffer goes back to the producer to be
+         * refilled in place, so for `cv::Mat` any other header still pointing
+         * at its pixels will see them overwritten. Clone what must outlive the
+         * next update(), or use poll() instead.
+         */
+        bool update() {
+            if (not (this->middle.load(memory_order_relaxed) & FRESH)) {
+                return false;
+            }
+            unsigned old = this->middle.exchange(this->front, memory_order_acq_rel);
+            this->front = old & ~FRESH;
+            return true;
+        }
+
+        /*! Return the item taken by the last successful update(). Consumer
+         * only.
+         */
+        T &latest() {
+            return this->bufs[this->front];
+        }
+
+        /*! Return `true` if a new item was moved into `out` or `false` if
+         * there was none. Consumer only.
+         *
+         * The old contents of `out` are released rather than recycled, so
+         * headers kept from earlier frames stay intact, at the cost of the
+         * producer allocating a fresh buffer.
+         */
+        bool poll(T &out) {
+            if (not this->update()) {
+                return false;
+            }
+            swap(out, this->latest());
+            this->latest() = T();
+            return true;
+        }
+
+        /*! Block until a new item is moved into `out`. Consumer only. */
+        void wait(T &out) {
+            while (not this->poll(out)) {
+                this_thread::yield();
+            }
+        }
+
+        /*! Return the number of items published so far. */
+        unsigned long published() const {
+            return this->nPublished.load(memory_order_relaxed);
+        }
+
+        /*! Return the number of items overwritten before the consumer picked
+         * them up.
+         */
+        unsigned long dropped() const {
+            return this->nDropped.load(memory_order_relaxed);
+        }
+    };
+
+    /*! How to place a group of threads on CPUs. */
+    enum Placement {
+        /*! Leave placement to the OS. */
+        NO_PINNING,
+        /*! Pin consecutive threads to CPUs sharing the same L2, then L3 cache,
+         * so neighbouring threads (eg a pipeline stage and its consumer) hand
+         * data over through a shared cache.
+         */
+        COMPACT,
+        /*! Pin consecutive threads to different L3, then L2 domains, to
+         * maximize the total cache available.
+         */
+        SCATTER
+    };
+
+    /*! Cache topology of the machine's CPUs. */
+    struct CpuTopology {
+        /*! Number of online CPUs. Their ids need not be `0..nCpus-1`. */
+        unsigned nCpus;
+        /*! Groups of CPUs sharing an L2 cache. */
+        vector<vector<unsigned>> l2Domains;
+        /*! Groups of CPUs sharing an L3 cache. */
+        vector<vector<unsigned>> l3Domains;
+
+        /*! Return the topology of this machine, read from sysfs on Linux.
+         * Elsewhere, or if unavailable, every CPU is its own domain.
+         */
+        static CpuTopology detect();
+
+        /*! Return all CPUs ordered so that assigning thread `i` to element
+         * `i % nCpus` gives the `placement`. Empty for `NO_PINNING`.
+         */
+        vector<unsigned> order(Placement placement) const;
+    };
+
+    /*! Restrict the calling thread to run on `cpus`. Return `false` if that
+     * failed, any id is too large for the OS CPU mask, or it is unsupported on
+     * this platform (it only works on Linux).
+     */
+    bool pinThread(const vector<unsigned> &cpus);
+
+    /*! Restrict `t` to run on `cpus`. See pinThread() above. */
+    bool pinThread(thread &t, const vector<unsigned> &cpus);
+
+    /*! Name the calling thread so it shows up in `top`, `perf` and debuggers.
+     * Linux truncates names to 15 characters. Return `false` on failure.
+     */
+    bool setThreadName(const string &name);
+
+    /*! Name `t`. Only supported on Linux; see setThreadName() above. */
+    bool setThreadName(thread &t, const string &name);
+
+    /*! A unit of work run by a `ThreadPool`. */
+    typedef function<void()> Task;
+
+    /*! A task the pool runs in place, without allocating or freeing it, for
+     * callers that post the same work over and over.
+     */
+    struct PoolTask {
+        virtual ~PoolTask() {}
+
+        /*! Called once on a pool thread per post. May delete `this`. */
+        virtual void run() = 0;
+    };
+
+    /*! A heap-allocated `Task` that deletes itself after running. */
+    struct _FuncTask : PoolTask {
+        Task func;
+
+        explicit _FuncTask(const Task &func) : func(func) {}
+        explicit _FuncTask(Task &&func) : func(move(func)) {}
+
+        void run() {
+            this->func();
+            delete this;
+        }
+    };
+
+    /*! Work-stealing deque of tasks (Chase & Lev, with the memory orderings
+     * from Lê et al., "Correct and Efficient Work-Stealing for Weak Memory
+     * Models").
+     *
+     * The owning thread pushes and pops at the bottom without locking; any
+     * other thread may steal from the top.
+     */
+    class WorkDeque {
+    private:
+        struct Array {
+            size_t mask;
+            unique_ptr<atomic<PoolTask *>[]> items;
+
+            Array(size_t capacity);
+
+            PoolTask *get(long long i) const {
+                return this->items[size_t(i) & this->mask].load(memory_order_relaxed);
+            }
+
+            void put(long long i, PoolTask *task) {
+                this->items[size_t(i) & this->mask].store(task, memory_order_relaxed);
+            }
+        };
+
+        atomic<long long> top;
+        char _pad0[CACHE_LINE_SIZE - sizeof(atomic<long long>)];
+        atomic<long long> bottom;
+        atomic<Array *> array;
+        // arrays replaced by growing, kept alive since thieves may still be
+        // reading them
+        vector<unique_ptr<Array>> arrays;
+
+    public:
+        WorkDeque(size_t capacity=256);
+
+        WorkDeque(const WorkDeque &) = delete;
+        WorkDeque &operator=(const WorkDeque &) = delete;
+
+        /*! Push a task at the bottom. Owner only. */
+        void push(PoolTask *task);
+
+        /*! Pop a task from the bottom, or return `NULL` if empty. Owner only.
+         */
+        PoolTask *pop();
+
+        /*! Steal a task from the top, or return `NULL` if empty or another
+         * thread won the race.
+         */
+        PoolTask *steal();
+    };
+
+    /*! Fixed-size pool of worker threads with work stealing.
+     *
+     * Each worker owns a `WorkDeque`; tasks submitted from a worker go on its
+     * own deque, tasks submitted from other threads go on a shared queue, and
+     * idle workers steal from each other before going to sleep.
+     */
+    class ThreadPool {
+    private:
+        vector<unique_ptr<WorkDeque>> deques;
+        vector<thread> workers;
+
+        mutex injectLock;
+        deque<PoolTask *> injected;
+
+        mutex sleepLock;
+        condition_variable wake;
+        // number of tasks enqueued but not yet taken
+        atomic<long> nQueued;
+        atomic<unsigned> nSleeping;
+        atomic<bool> stopping;
+
+        void _enqueue(PoolTask *task);
+        PoolTask *_findTask();
+        void _workerLoop(unsigned i, unsigned cpu);
+
+    public:
+        /*! Start `nThreads` workers (at least 1), named "pool-<i>" and pinned
+         * to CPUs according to `placement`.
+         */
+        ThreadPool(unsigned nThreads=thread::hardware_concurrency(), Placement placement=NO_PINNING);
+
+        /*! Run all remaining tasks, then join the workers. */
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        /*! Return the number of worker threads. */
+        size_t size() const {
+            return this->workers.size();
+        }
+
+        /*! Run `func(args...)` on the pool and return a `future` for its
+         * result (or exception).
+         */
+        template <class FuncT, class... Args>
+        future<typename result_of<FuncT(Args...)>::type> submit(FuncT &&func, Args&&... args) {
+            typedef typename result_of<FuncT(Args...)>::type ResultT;
+
+            auto task = make_shared<packaged_task<ResultT()>>(
+                    bind(forward<FuncT>(func), forward<Args>(args)...)
+                    );
+            future<ResultT> res = task->get_future();
+            this->_enqueue(new _FuncTask([task]() { (*task)(); }));
+            return res;
+        }
+
+        /*! Call `func(i)` for each `i` in [`begin`, `end`), in chunks of
+         * `grain` indices spread over the pool. Blocks until done, running
+         * pool tasks on the calling thread meanwhile, so it is safe to call
+         * from inside a task.
+         *
+         * @throws
+         * Rethrows the first exception thrown by `func`.
+         */
+        template <class FuncT>
+        void parallelFor(size_t begin, size_t end, size_t grain, const FuncT &func) {
+            if (end <= begin) {
+                return;
+            }
+            grain = max(grain, size_t(1));
+            size_t nChunks = (end - begin + grain - 1) / grain;
+
+            atomic<size_t> remaining(nChunks);
+            mutex errLock;
+            exception_ptr err;
+
+            auto runChunk = [&](size_t chunk) {
+                size_t lo = begin + chunk * grain;
+                size_t hi = min(lo + grain, end);
+                try {
+                    for (size_t i = lo; i < hi; i++) {
+                        func(i);
+                    }
+                } catch (...) {
+                    lock_guard<mutex> lk(errLock);
+                    if (not err) {
+                        err = current_exception();
+                    }
+                }
+                remaining.fetch_sub(1, memory_order_acq_rel);
+            };
+
+            for (size_t chunk = 1; chunk < nChunks; chunk++) {
+                this->_enqueue(new _FuncTask([&runChunk, chunk]() { runChunk(chunk); }));
+            }
+            runChunk(0);
+
+            while (remaining.load(memory_order_acquire) != 0) {
+                if (not this->runPending()) {
+                    this_thread::yield();
+                }
+            }
+            if (err) {
+                rethrow_exception(err);
+            }
+        }
+
+        /*! Run `task` on the pool without tracking its result. */
+        void post(const Task &task) {
+            this->_enqueue(new _FuncTask(task));
+        }
+
+        /*! Call `task.run()` on the pool without allocating. `task` must stay
+         * alive, and must not be posted again, until run() has returned.
+         */
+        void post(PoolTask &task) {
+            this->_enqueue(&task);
+        }
+
+        /*! Run one queued task on the calling thread, if there is one. Return
+         * `true` if a task was run.
+         */
+        bool runPending();
+    };
+
+    /*! Return a process-wide pool with one worker per hardware thread,
+     * created on first use.
+     */
+    ThreadPool &defaultPool();
+
+    /*! Multi-stage processing pipeline.
+     *
+     * Each stage runs on its own thread and is fed by a bounded `Queue`, so
+     * while one stage works on frame N the previous stage can already work on
+     * frame N+1. Each edge applies back-pressure or drops items according to
+     * its `OverflowPolicy`.
+     *
+     * All stages work on the same item type `T`, typically a struct holding
+     * the frame plus whatever each stage computes from it. A stage returns
+     * `false` to discard the item.
+     *
+     * Suggested usage:
+     *
+     *      thr::Pipeline<FrameData> pipe;
+     *      pipe.addStage("convert", convert, 2, thr::DROP_OLDEST);
+     *      pipe.addStage("segment", segment);
+     *      pipe.addStage("track", track);
+     *      pipe.start();
+     *
+     *      pipe.push(data);    // capture thread
+     *      pipe.wait(data);    // output thread
+     */
+    template <typename T>
+    class Pipeline {
+    public:
+        typedef function<bool(T &)> StageFunc;
+
+        /*! Snapshot of a stage's counters. */
+        struct StageStats {
+            string name;
+            /*! Items taken from the input queue. */
+            unsigned long processed;
+            /*! Items the stage function discarded. */
+            unsigned long discarded;
+            /*! Items dropped by the input queue's overflow policy. */
+            unsigned long dropped;
+            /*! Items waiting in the input queue. */
+            size_t queued;
+            /*! Capacity of the input queue. */
+            size_t capacity;
+            /*! Total time spent inside the stage function, in seconds. */
+            float busySecs;
+        };
+
+    private:
+        struct Stage {
+            string name;
+            StageFunc func;
+            Queue<T> in;
+            atomic<unsigned long> processed;
+            atomic<unsigned long> discarded;
+            atomic<long long> busyNs;
+            thread worker;
+
+            Stage(const string &name, const StageFunc &func, size_t capacity, OverflowPolicy policy)
+            : name(name), func(func), in(capacity, policy), processed(0), discarded(0), busyNs(0) {
+            }
+        };
+
+        vector<unique_ptr<Stage>> stages;
+        Queue<T> out;
+        bool started;
+
+        void _run(size_t i) {
+            Stage &stage = *this->stages[i];
+            Queue<T> &next = (i + 1 < this->stages.size()) ? this->stages[i + 1]->in : this->out;
+
+            T item;
+            while (stage.in.wait(item)) {
+                auto start = chrono::steady_clock::now();
+                bool keep = stage.func(item);
+                auto ns = chrono::duration_cast<chrono::nanoseconds>(
+                        chrono::steady_clock::now() - start
+                        ).count();
+                stage.busyNs.fetch_add(ns, memory_order_relaxed);
+                stage.processed.fetch_add(1, memory_order_relaxed);
+
+                if (not keep) {
+                    stage.discarded.fetch_add(1, memory_order_relaxed);
+                } else if (not next.push(move(item))) {
+                    break;
+                }
+            }
+            next.close();
+        }
+
+        Queue<T> &_firstQueue() {
+            if (this->stages.empty()) {
+                throw logic_error("can't push into a pipeline with no stages");
+            }
+            Queue<T> &first = this->stages.front()->in;
+            if (not this->started and first.policy == BLOCK) {
+                throw logic_error("can't push into a blocking pipeline before starting it");
+            }
+            return first;
+        }
+
+        void _join() {
+            for (auto &stage : this->stages) {
+                if (stage->worker.joinable()) {
+                    stage->worker.join();
+                }
+            }
+        }
+
+    public:
+        /*! `outCapacity` and `outPolicy` configure the queue holding finished
+         * items.
+         */
+        Pipeline(size_t outCapacity=4, OverflowPolicy outPolicy=BLOCK)
+        : out(outCapacity, outPolicy), started(false) {
+        }
+
+        Pipeline(const Pipeline &) = delete;
+        Pipeline &operator=(const Pipeline &) = delete;
+
+        /*! Close every queue, discarding anything still in flight, and join
+         * the stage threads.
+         */
+        ~Pipeline() {
+            for (auto &stage : this->stages) {
+                stage->in.close();
+            }
+            this->out.close();
+            this->_join();
+        }
+
+        /*! Append a stage fed by a queue holding at most `capacity` items.
+         *
+         * @throws logic_error
+         * Thrown if the pipeline was already started.
+         */
+        void addStage(
+                const string &name,
+                const StageFunc &func,
+                size_t capacity=4,
+                OverflowPolicy policy=BLOCK
+                ) {
+            if (this->started) {
+                throw logic_error("can't add stages to a running pipeline");
+            }
+            this->stages.emplace_back(new Stage(name, func, capacity, policy));
+        }
+
+        /*! Start one thread per stage, named after the stage. With `COMPACT`
+         * placement, consecutive stages are pinned to CPUs sharing a cache.
+         *
+         * @throws logic_error
+         * Thrown if there are no stages or the pipeline was already started.
+         */
+        void start(Placement placement=NO_PINNING) {
+            if (this->stages.empty() or this->started) {
+                throw logic_error("pipeline needs stages and can only be started once");
+            }
+            this->started = true;
+            vector<unsigned> cpus;
+            if (placement != NO_PINNING) {
+                cpus = CpuTopology::detect().order(placement);
+            }
+            for (size_t i = 0; i < this->stages.size(); i++) {
+                this->stages[i]->worker = thread(&Pipeline::_run, this, i);
+                setThreadName(this->stages[i]->worker, this->stages[i]->name);
+                if (not cpus.empty()) {
+                    pinThread(this->stages[i]->worker, vector<unsigned>{cpus[i % cpus.size()]});
+                }
+            }
+        }
+
+        /*! Feed an item into the first stage. Return `false` if the pipeline
+         * was stopped.
+         *
+         * @throws logic_error
+         * Thrown if the pipeline has no stages, or hasn't been started and
+         * the first queue blocks when full (nothing would ever drain it).
+         */
+        bool push(const T &in) {
+            return this->_firstQueue().push(in);
+        }
+
+        /*! Like push(const T &), but move `in` into the first stage. */
+        bool push(T &&in) {
+            return this->_firstQueue().push(move(in));
+        }
+
+        /*! Return `true` if a finished item was stored in `item` or `false`
+         * if there was none.
+         */
+        bool poll(T &item) {
+            return this->out.poll(item);
+        }
+
+        /*! Block until a finished item is stored in `item`. Return `false` if
+         * the pipeline was stopped and fully drained.
+         */
+        bool wait(T &item) {
+            return this->out.wait(item);
+        }
+
+        /*! Stop accepting input, let the stages drain what is already queued,
+         * and join their threads. Finished items can still be taken with
+         * poll(), but with a `BLOCK` output queue someone must keep taking
+         * them or the last stage can't finish.
+         */
+        void stop() {
+            if (not this->started) {
+                return;
+            }
+            this->stages.front()->in.close();
+            this->_join();
+        }
+
+        /*! Return a snapshot of every stage's counters, in stage order. */
+        vector<StageStats> stats() {
+            vector<StageStats> res;
+            for (auto &stage : this->stages) {
+                unsigned long dropped;
+                {
+                    lock_guard<mutex> lk(stage->in.lock);
+                    dropped = stage->in.dropped;
+                }
+                res.push_back(StageStats{
+                        stage->name,
+                        stage->processed.load(memory_order_relaxed),
+                        stage->discarded.load(memory_order_relaxed),
+                        dropped,
+                        stage->in.size(),
+                        stage->in.capacity,
+                        float(stage->busyNs.load(memory_order_relaxed)) / 1e9f
+                        });
+            }
+            return res;
         }
     };
 
-    template<typename T>
-    mutex Queue<T>::lock;
+    /*! Latest value of a trivially copyable `T`, written by one thread and
+     * read by any number of threads without locks or allocation (a seqlock).
+     *
+     * The writer bumps a sequence number to odd, stores the value, then bumps
+     * it back to even; readers retry if they saw an odd or changed sequence
+     * number. Readers never block the writer. The value is stored as words of
+     * relaxed atomics so concurrent reads aren't data races.
+     *
+     * Suggested usage:
+     *
+     *      thr::Published<mouse::State> latestState;
+     *
+     *      // tracker thread
+     *      latestState.store(state);
+     *
+     *      // UI thread
+     *      mouse::State state = latestState.load();
+     */
+    template <typename T>
+    class Published {
+        static_assert(is_trivially_copyable<T>::value, "`T` must be trivially copyable");
+
+    private:
+        static const size_t N_WORDS = (sizeof(T) + sizeof(uintptr_t) - 1) / sizeof(uintptr_t);
+
+        atomic<unsigned long> seq;
+        atomic<uintptr_t> words[N_WORDS];
+
+    public:
+        Published(const T &init=T()) : seq(0) {
+            this->store(init);
+        }
+
+        Published(const Published &) = delete;
+        Published &operator=(const Published &) = delete;
+
+        /*! Publish a new value. Only one thread may call this. */
+        void store(const T &val) {
+            uintptr_t buf[N_WORDS] = {};
+            memcpy(buf, &val, sizeof(T));
+
+            unsigned long s = this->seq.load(memory_order_relaxed);
+            this->seq.store(s + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            for (size_t i = 0; i < N_WORDS; i++) {
+                this->words[i].store(buf[i], memory_order_relaxed);
+            }
+            this->seq.store(s + 2, memory_order_release);
+        }
+
+        /*! Return a consistent snapshot of the latest value. */
+        T load() const {
+            uintptr_t buf[N_WORDS];
+            unsigned long before, after;
+            do {
+                before = this->seq.load(memory_order_acquire);
+                for (size_t i = 0; i < N_WORDS; i++) {
+                    buf[i] = this->words[i].load(memory_order_relaxed);
+                }
+                atomic_thread_fence(memory_order_acquire);
+                after = this->seq.load(memory_order_relaxed);
+            } while ((before & 1) or before != after);
+
+            T val;
+            memcpy(&val, buf, sizeof(T));
+            return val;
+        }
+
+        /*! Return the number of values stored so far, counting the initial
+         * one. Lets readers cheaply check whether anything changed.
+         */
+        unsigned long version() const {
+            return this->seq.load(memory_order_acquire) / 2;
+        }
+    };
+
+    /*! Back off inside a spin loop: a pause hint for the first few rounds,
+     * then yield so a descheduled lock holder gets to run. `spins` counts
+     * rounds so far and is updated.
+     */
+    inline void _spinWait(unsigned &spins) {
+        if (spins++ < 64) {
+#ifdef __SSE2__
+            _mm_pause();
+#endif
+        } else {
+            this_thread::yield();
+        }
+    }
+
+    /*! Reader-writer spinlock for short critical sections, packed into a
+     * single word so it can sit on the same cache line as the data it
+     * guards. Any number of readers can hold it at once; a waiting writer
+     * keeps new readers out so it can't be starved.
+     *
+     * Follows the standard Lockable and SharedLockable naming, so writers
+     * can use `lock_guard`; readers can use `SharedLockGuard`.
+     */
+    class SharedSpinLock {
+    private:
+        static const unsigned WRITER = 1u << 31;
+        static const unsigned WRITER_WAITING = 1u << 30;
+
+        /*! `WRITER` and `WRITER_WAITING` bits, plus the number of readers. */
+        atomic<unsigned> state;
+
+    public:
+        SharedSpinLock() : state(0) {}
+
+        SharedSpinLock(const SharedSpinLock &) = delete;
+        SharedSpinLock &operator=(const SharedSpinLock &) = delete;
+
+        bool try_lock() {
+            unsigned s = this->state.load(memory_order_relaxed);
+            return (s & ~WRITER_WAITING) == 0
+                and this->state.compare_exchange_strong(s, WRITER, memory_order_acquire);
+        }
+
+        void lock() {
+            unsigned spins = 0;
+            while (1) {
+                unsigned s = this->state.load(memory_order_relaxed);
+                if ((s & ~WRITER_WAITING) == 0) {
+                    if (this->state.compare_exchange_weak(s, WRITER, memory_order_acquire)) {
+                        return;
+                    }
+                } else if (not (s & WRITER_WAITING)) {
+                    this->state.fetch_or(WRITER_WAITING, memory_order_relaxed);
+                }
+                _spinWait(spins);
+            }
+        }
+
+        void unlock() {
+            this->state.fetch_and(~WRITER, memory_order_release);
+        }
+
+        bool try_lock_shared() {
+            unsigned s = this->state.load(memory_order_relaxed);
+            return not (s & (WRITER | WRITER_WAITING))
+                and this->state.compare_exchange_strong(s, s + 1, memory_order_acquire);
+        }
+
+        void lock_shared() {
+            unsigned spins = 0;
+            while (1) {
+                unsigned s = this->state.load(memory_order_relaxed);
+                if (not (s & (WRITER | WRITER_WAITING))
+                        and this->state.compare_exchange_weak(s, s + 1, memory_order_acquire)) {
+                    return;
+                }
+                _spinWait(spins);
+            }
+        }
+
+        void unlock_shared() {
+            this->state.fetch_sub(1, memory_order_release);
+        }
+    };
+
+    /*! Holds a shared (reader) lock for its lifetime, like `lock_guard` does
+     * for an exclusive one.
+     */
+    template <typename LockT>
+    class SharedLockGuard {
+    private:
+        LockT &lk;
+
+    public:
+        explicit SharedLockGuard(LockT &lk) : lk(lk) {
+            this->lk.lock_shared();
+        }
+
+        /*! Take over a shared lock already held by the caller. */
+        SharedLockGuard(LockT &lk, adopt_lock_t) : lk(lk) {}
+
+        ~SharedLockGuard() {
+            this->lk.unlock_shared();
+        }
+
+        SharedLockGuard(const SharedLockGuard &) = delete;
+        SharedLockGuard &operator=(const SharedLockGuard &) = delete;
+    };
+
+    /*! Runs one-shot and periodic tasks on a `ThreadPool` at given times.
+     *
+     * Timers live in a hierarchical timing wheel (4 levels of 64 slots) driven
+     * by a monotonic clock, so scheduling and cancelling are O(1), and each
+     * tick only touches the slots that are due. Timer nodes are recycled and
+     * handed to the pool in place, so once warmed up neither scheduling nor
+     * firing allocates.
+     *
+     * A timer that comes due while its previous run is still queued or
+     * running skips that run, so a slow periodic task never overlaps itself.
+     *
+     * Suggested usage:
+     *
+     *      thr::Scheduler sched;
+     *      auto id = sched.every(chrono::seconds(1), [&]() { redetectFace(); });
+     *      ...
+     *      sched.cancel(id);
+     */
+    class Scheduler {
+    public:
+        typedef chrono::steady_clock ClockT;
+
+        /*! Handle to a scheduled task, used to cancel it. */
+        struct TaskId {
+            size_t i;
+            unsigned long gen;
+        };
+
+    private:
+        static const unsigned N_LEVELS = 4;
+        static const unsigned SLOT_BITS = 6;
+        static const unsigned N_SLOTS = 1 << SLOT_BITS;
+
+        struct Timer : PoolTask {
+            Task task;
+            // set while a run is posted to the pool and hasn't finished
+            atomic<bool> inFlight;
+            // tick at which the task is due
+            unsigned long long expiry;
+            // period in ticks, or 0 for one-shot tasks
+            unsigned long long period;
+            // bumped whenever the timer is recycled, invalidating old ids
+            unsigned long gen;
+            bool active;
+            // index in `timers`
+            size_t i;
+            // wheel position and intrusive links within the slot
+            unsigned level;
+            unsigned slot;
+            Timer *prev;
+            Timer *next;
+
+            Timer() : inFlight(false) {}
+
+            void run() {
+                this->task();
+                this->inFlight.store(false, memory_order_release);
+            }
+        };
+
+        ThreadPool &pool;
+        ClockT::duration tick;
+        ClockT::time_point startTime;
+        unsigned long long curTick;
+
+        Timer *wheel[N_LEVELS][N_SLOTS];
+        vector<unique_ptr<Timer>> timers;
+        vector<size_t> freeTimers;
+        size_t nActive;
+
+        mutex lock;
+        condition_variable wake;
+        bool stopping;
+        thread driver;
+
+        TaskId _add(ClockT::duration delay, ClockT::duration period, const Task &task);
+        void _insert(Timer *t);
+        void _unlink(Timer *t);
+        void _free(Timer *t);
+        void _advance();
+        void _run();
+
+    public:
+        /*! Run tasks on `pool`, with a timer resolution of `tick`. */
+        Scheduler(ThreadPool &pool=defaultPool(), ClockT::duration tick=chrono::milliseconds(1));
+
+        /*! Stop the driver thread and wait for runs already handed to the pool.
+         * Pending tasks never run.
+         */
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        /*! Run `task` once, `delay` from now. */
+        TaskId after(ClockT::duration delay, const Task &task) {
+            return this->_add(delay, ClockT::duration::zero(), task);
+        }
+
+        /*! Run `task` once at `when`. */
+        TaskId at(ClockT::time_point when, const Task &task) {
+            return this->_add(when - ClockT::now(), ClockT::duration::zero(), task);
+        }
+
+        /*! Run `task` every `period`, starting `period` from now. `period` is
+         * rounded up to whole ticks, and to at least one.
+         */
+        TaskId every(ClockT::duration period, const Task &task) {
+            period = max(period, this->tick);
+            return this->_add(period, period, task);
+        }
+
+        /*! Cancel a task. Return `false` if it already ran (for one-shot
+         * tasks) or was already cancelled. A run already handed to the pool
+         * still completes.
+         */
+        bool cancel(TaskId id);
+
+        /*! Return the number of scheduled tasks. */
+        size_t size();
+    };
 }
@@ -0,0 +1,91 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Cost of handing a value back and forth between two threads, unpinned and
+ * pinned to CPUs that do or don't share a cache.
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace std;
+using namespace io;
+
+const unsigned N_ROUND_TRIPS = 200000;
+
+/*! Return the average round-trip time in nanoseconds. Empty `cpus` means no
+ * pinning.
+ */
+float pingPong(const vector<unsigned> &cpus) {
+    atomic<unsigned> ball(0);
+
+    thread other([&]() {
+        if (not cpus.empty()) {
+            thr::pinThread(vector<unsigned>{cpus[1]});
+        }
+        for (unsigned i = 0; i < N_ROUND_TRIPS; i++) {
+            while (ball.load(memory_order_acquire) != 2 * i + 1) {
+                this_thread::yield();
+            }
+            ball.store(2 * i + 2, memory_order_release);
+        }
+    });
+    if (not cpus.empty()) {
+        thr::pinThread(vector<unsigned>{cpus[0]});
+    }
+
+    auto start = ktime::ClockT::now();
+    for (unsigned i = 0; i < N_ROUND_TRIPS; i++) {
+        ball.store(2 * i + 1, memory_order_release);
+        while (ball.load(memory_order_acquire) != 2 * i + 2) {
+            this_thread::yield();
+        }
+    }
+    float secs = ktime::toSecs(ktime::ClockT::now() - start);
+    other.join();
+
+    return secs / N_ROUND_TRIPS * 1e9f;
+}
+
+int main() {
+    thr::CpuTopology topo = thr::CpuTopology::detect();
+    print("cpus:", topo.nCpus, "L2 domains:", topo.l2Domains.size(), "L3 domains:", topo.l3Domains.size());
+
+    print("unpinned (ns/round trip):", pingPong(vector<unsigned>()));
+
+    vector<unsigned> compact = topo.order(thr::COMPACT);
+    vector<unsigned> scatter = topo.order(thr::SCATTER);
+    if (topo.nCpus < 2 or not thr::pinThread(vector<unsigned>{compact[0]})) {
+        print("pinning unsupported or only one CPU, skipping pinned runs");
+        return 0;
+    }
+    print("pinned, shared cache (ns/round trip):", pingPong(vector<unsigned>{compact[0], compact[1]}));
+    print("pinned, spread out (ns/round trip):", pingPong(vector<unsigned>{scatter[0], scatter[1]}));
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* seq::cluster against seq::clusterPoints, on random points spread over an
+ * area that keeps the expected number of neighbours per point constant.
+ */
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace std;
+using namespace io;
+
+typedef kmath::Point<float> Pt;
+
+const float MAX_DIST = 10;
+
+/*! Return the average seconds per call of `func` over `nRuns` calls. */
+template <class FuncT>
+float timeIt(unsigned nRuns, const FuncT &func) {
+    auto start = ktime::ClockT::now();
+    for (unsigned i = 0; i < nRuns; i++) {
+        func();
+    }
+    return ktime::toSecs(ktime::ClockT::now() - start) / float(nRuns);
+}
+
+int main() {
+    mt19937 rng(42);
+    for (size_t n : {size_t(100), size_t(1000), size_t(10000)}) {
+        // about 1 point per `MAX_DIST` x `MAX_DIST` square
+        float side = MAX_DIST * sqrt(float(n));
+        uniform_real_distribution<float> coord(0, side);
+        vector<Pt> pts(n);
+        for (auto &p : pts) {
+            p = Pt(coord(rng), coord(rng));
+        }
+
+        vector<vector<Pt>> clusters;
+        unsigned nRuns = n <= 1000 ? 20 : 2;
+        float naive = timeIt(nRuns, [&]() {
+            seq::cluster(
+                    pts,
+                    [](const Pt &a, const Pt &b) {
+                        return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+                    },
+                    MAX_DIST * MAX_DIST,
+                    clusters
+                   );
+        });
+        size_t nNaive = clusters.size();
+        auto getPos = [](const Pt &p) { return p; };
+        float complete = timeIt(nRuns, [&]() {
+            seq::clusterPoints(pts, getPos, MAX_DIST, clusters);
+        });
+        size_t nComplete = clusters.size();
+        float single = timeIt(nRuns, [&]() {
+            seq::clusterPoints(pts, getPos, MAX_DIST, clusters, seq::SINGLE);
+        });
+
+        print("n =", n);
+        print("    cluster (ms):", naive * 1e3f, "clusters:", nNaive);
+        print("    clusterPoints, complete (ms):", complete * 1e3f, "clusters:", nComplete);
+        print("    clusterPoints, single (ms):", single * 1e3f, "clusters:", clusters.size());
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* dict::FlatDict against dict::Dict (unordered_map): inserting n distinct
+ * keys, then looking each of them up, for int, float and string keys. Then
+ * dict::ConcurrentDict lookup throughput as reader threads are added, with
+ * and without lock counting, over many keys and over one hot key, and
+ * dict::LRUCache against dict::ClockCache on skewed keys.
+ */
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace std;
+using namespace io;
+
+/*! Print the nanoseconds per insert and per lookup of `keys` into a fresh
+ * `DictT`.
+ */
+template <class DictT, class KeyT>
+void benchDict(const char *name, const vector<KeyT> &keys) {
+    DictT d;
+    auto start = ktime::ClockT::now();
+    for (const KeyT &key : keys) {
+        d[key] = 1;
+    }
+    float insertNs = ktime::toSecs(ktime::ClockT::now() - start) / float(keys.size()) * 1e9f;
+
+    start = ktime::ClockT::now();
+    unsigned found = 0;
+    for (const KeyT &key : keys) {
+        found += d.find(key)->second;
+    }
+    float lookupNs = ktime::toSecs(ktime::ClockT::now() - start) / float(keys.size()) * 1e9f;
+
+    print("   ", name, "insert (ns):", insertNs, "lookup (ns):", lookupNs, found == keys.size() ? "" : "BAD");
+}
+
+template <class KeyT>
+void benchBoth(const char *keyName, vector<KeyT> keys) {
+    // look up in a different order than inserted
+    vector<KeyT> shuffled(keys);
+    shuffle(shuffled.begin(), shuffled.end(), mt19937(1));
+
+    print(keyName, "keys, n =", keys.size());
+    benchDict<dict::Dict<KeyT, unsigned>>("Dict    ", shuffled);
+    benchDict<dict::FlatDict<KeyT, unsigned>>("FlatDict", shuffled);
+}
+
+/*! Print the total lookups per second of 1, 2, 4, ... threads all reading
+ * random keys out of `n` from the same `ConcurrentDict`. With `n` 1, every
+ * read hits the same shard. There are always at least 4 threads, to show
+ * the cost of sharing a shard even on machines with few cores.
+ */
+template <class StatsT>
+void benchConcurrentReads(const char *name, size_t n) {
+    dict::ConcurrentDict<int, unsigned, hash<int>, equal_to<int>, StatsT> d;
+    for (size_t i = 0; i < n; i++) {
+        d.upsert(int(i), 1);
+    }
+
+    print("ConcurrentDict reads,", name, "n =", n);
+    unsigned maxThreads = max(4u, thread::hardware_concurrency());
+    for (unsigned nThreads = 1; nThreads <= maxThreads; nThreads *= 2) {
+        vector<thread> readers;
+        atomic<unsigned long> found(0);
+        auto start = ktime::ClockT::now();
+        for (unsigned t = 0; t < nThreads; t++) {
+            readers.push_back(thread([&d, &found, n, t]() {
+                unsigned val, local = 0;
+                mt19937 rng(t);
+                for (size_t i = 0; i < 1000000; i++) {
+                    local += d.get(int(rng() % n), val) ? val : 0;
+                }
+                found += local;
+            }));
+        }
+        for (auto &r : readers) {
+            r.join();
+        }
+        float secs = ktime::toSecs(ktime::ClockT::now() - start);
+        print("   ", nThreads, "threads, Mlookups/s:", float(nThreads) / secs, found == nThreads * 1000000ul ? "" : "BAD");
+    }
+}
+
+/*! Print the nanoseconds per lookup (with a put on each miss) and the hit
+ * rate of a `CacheT` holding a tenth of `keys`' distinct values.
+ */
+template <class CacheT>
+void benchCache(const char *name, const vector<int> &keys, size_t capacity) {
+    CacheT cache(capacity);
+    auto start = ktime::ClockT::now();
+    for (int key : keys) {
+        if (cache.find(key) == NULL) {
+            cache.put(key, key);
+        }
+    }
+    float ns = ktime::toSecs(ktime::ClockT::now() - start) / float(keys.size()) * 1e9f;
+    print("   ", name, "ns per lookup:", ns, "hit rate:", cache.stats().hitRate());
+}
+
+int main() {
+    for (size_t n = 1000; n <= 10000000; n *= 10) {
+        vector<int> ints(n);
+        vector<float> floats(n);
+        vector<string> strings(n);
+        for (size_t i = 0; i < n; i++) {
+            ints[i] = int(i * 2654435761u);
+            floats[i] = float(i) * 0.5f;
+            strings[i] = "key" + to_string(i);
+        }
+        benchBoth("int", ints);
+        benchBoth("float", floats);
+        benchBoth("string", strings);
+    }
+    benchConcurrentReads<dict::NoShardStats>("uncounted,", 100000);
+    benchConcurrentReads<dict::ShardStatsRecorder>("counted,", 100000);
+    benchConcurrentReads<dict::NoShardStats>("uncounted,", 1);
+    benchConcurrentReads<dict::ShardStatsRecorder>("counted,", 1);
+
+    // exponentially distributed keys, so a few are much hotter than the rest
+    size_t nDistinct = 100000;
+    vector<int> skewed(5000000);
+    mt19937 rng(1);
+    exponential_distribution<double> expDist(1);
+    for (int &key : skewed) {
+        key = int(double(nDistinct) * min(1.0, expDist(rng) / 10));
+    }
+    print("caches, capacity =", nDistinct / 10);
+    benchCache<dict::LRUCache<int, int>>("LRUCache  ", skewed, nDistinct / 10);
+    benchCache<dict::ClockCache<int, int>>("ClockCache", skewed, nDistinct / 10);
+    return 0;
+}
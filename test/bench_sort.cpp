@@ -0,0 +1,86 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* seq::radixSort and seq::mergeSort against std::sort and std::stable_sort,
+ * on random ints and floats.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace std;
+using namespace io;
+
+/*! Return the average milliseconds `sortFunc` takes to sort a copy of `in`,
+ * over `nRuns` runs.
+ */
+template <class T, class SortFuncT>
+float timeSort(const vector<T> &in, unsigned nRuns, const SortFuncT &sortFunc) {
+    float secs = 0;
+    for (unsigned i = 0; i < nRuns; i++) {
+        vector<T> v(in);
+        auto start = ktime::ClockT::now();
+        sortFunc(v);
+        secs += ktime::toSecs(ktime::ClockT::now() - start);
+    }
+    return secs / float(nRuns) * 1e3f;
+}
+
+template <class T>
+void benchAll(const char *name, const vector<T> &in) {
+    unsigned nRuns = in.size() <= 100000 ? 20 : 3;
+    print(name, "n =", in.size());
+    print("    std::sort (ms):", timeSort(in, nRuns, [](vector<T> &v) { sort(v.begin(), v.end()); }));
+    print("    std::stable_sort (ms):", timeSort(in, nRuns, [](vector<T> &v) {
+        stable_sort(v.begin(), v.end());
+    }));
+    print("    radixSort (ms):", timeSort(in, nRuns, [](vector<T> &v) { seq::radixSort(v); }));
+    print("    mergeSort, PAR (ms):", timeSort(in, nRuns, [](vector<T> &v) {
+        seq::mergeSort(seq::execution::PAR, v);
+    }));
+}
+
+int main() {
+    mt19937 rng(42);
+    uniform_int_distribution<int> intDist;
+    uniform_real_distribution<float> floatDist(-1e6f, 1e6f);
+    print("pool threads:", thr::defaultPool().size());
+    for (size_t n = 1000; n <= 10000000; n *= 10) {
+        vector<int> ints(n);
+        vector<float> floats(n);
+        for (size_t i = 0; i < n; i++) {
+            ints[i] = intDist(rng);
+            floats[i] = floatDist(rng);
+        }
+        benchAll("int", ints);
+        benchAll("float", floats);
+    }
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/* Throughput of the `thr` queues with N producers and N consumers. */
+
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace std;
+using namespace io;
+
+const unsigned N_ITEMS = 1 << 20;
+
+template <class QueueT>
+float timeQueue(QueueT &q, unsigned nThreads) {
+    unsigned perThread = N_ITEMS / nThreads;
+    vector<thread> threads;
+
+    auto start = ktime::ClockT::now();
+    for (unsigned t = 0; t < nThreads; t++) {
+        threads.push_back(thread([&]() {
+            for (unsigned i = 0; i < perThread; i++) {
+                q.push(int(i));
+            }
+        }));
+        threads.push_back(thread([&]() {
+            int item;
+            for (unsigned i = 0; i < perThread; i++) {
+                q.wait(item);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    return ktime::toSecs(ktime::ClockT::now() - start);
+}
+
+/*! Average one-way hand-off latency, in nanoseconds, of two threads
+ * bouncing an item back and forth over a pair of `SPSCQueue`s.
+ */
+float spscHopNs(unsigned nRoundTrips) {
+    thr::SPSCQueue<int> there(2), back(2);
+    thread echo([&]() {
+        int item;
+        for (unsigned i = 0; i < nRoundTrips; i++) {
+            there.wait(item);
+            back.push(move(item));
+        }
+    });
+
+    auto start = ktime::ClockT::now();
+    int item = 0;
+    for (unsigned i = 0; i < nRoundTrips; i++) {
+        there.push(move(item));
+        back.wait(item);
+    }
+    float secs = ktime::toSecs(ktime::ClockT::now() - start);
+    echo.join();
+    return secs / float(2 * nRoundTrips) * 1e9f;
+}
+
+int main() {
+    print("threads", "Queue (Mitems/s)", "RingQueue (Mitems/s)");
+    for (unsigned nThreads : {1u, 2u, 4u, 8u}) {
+        thr::Queue<int> q;
+        thr::RingQueue<int> rq(1024);
+        float qSecs = timeQueue(q, nThreads);
+        float rqSecs = timeQueue(rq, nThreads);
+        print(nThreads, N_ITEMS / qSecs / 1e6f, N_ITEMS / rqSecs / 1e6f);
+    }
+
+    thr::SPSCQueue<int> sq(1024);
+    print("SPSCQueue, 1 producer/1 consumer (Mitems/s):", N_ITEMS / timeQueue(sq, 1) / 1e6f);
+    print("SPSCQueue, 2-thread ping-pong hop (ns):", spscHopNs(100000));
+    return 0;
+}
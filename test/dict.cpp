@@ -25,8 +25,38 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include <cassert>
+#include <sstream>
+#include <string>
+#include <thread>
 
 #include "../core.hpp"
+#include "../src/argparse.hpp"
+
+/*! Hashes keys in blocks of 1000 to the same value, to force collisions. */
+struct ThousandsHash {
+    size_t operator()(uint64_t k) const {
+        return size_t(k / 1000);
+    }
+};
+
+typedef unsigned (*Checker)(vector<string>);
+
+unsigned chkNone(vector<string> args) {
+    return 0;
+}
+
+unsigned chkOne(vector<string> args) {
+    if (args.empty()) {
+        throw invalid_argument("missing argument");
+    }
+    return 1;
+}
+
+constexpr dict::StaticEntry<Checker> CHKERS[] = {{"-v", chkNone}, {"-n", chkOne}, {"--name", chkOne}};
+constexpr dict::StaticEntry<int> NUMBERS[] = {
+    {"one", 1}, {"two", 2}, {"three", 3}, {"four", 4}, {"five", 5}, {"six", 6}, {"seven", 7},
+    {"eight", 8}, {"nine", 9}, {"ten", 10}, {"eleven", 11}, {"twelve", 12}, {"", 0}
+};
 
 int main() {
     vector<float> v{1, 1, 2, 3};
@@ -34,5 +64,231 @@ int main() {
     v.clear();
     assert((dict::countElems(v.begin(), v.end()) == dict::makeDict<float, unsigned>()));
 
+    dict::FlatDict<int, int> flat;
+    for (int i = 0; i < 10000; i++) {
+        flat[i * 7] = i;
+    }
+    assert(flat.size() == 10000);
+    for (int i = 0; i < 10000; i++) {
+        assert(flat.at(i * 7) == i and flat.count(i * 7 + 1) == 0);
+    }
+    for (int i = 0; i < 10000; i += 2) {
+        assert(flat.erase(i * 7) == 1);
+    }
+    assert(flat.size() == 5000 and flat.erase(0) == 0);
+    size_t nIterated = 0;
+    for (const auto &kv : flat) {
+        assert(kv.second % 2 == 1 and kv.first == kv.second * 7);
+        nIterated++;
+    }
+    assert(nIterated == 5000);
+    assert(not flat.insert(make_pair(7, 0)).second and flat.at(7) == 1);
+    dict::FlatDict<int, int> flatCopy(flat);
+    assert(flatCopy == flat);
+    flat.clear();
+    assert(flat.empty() and flat.find(7) == flat.end() and flatCopy.size() == 5000);
+
+    // force the MAX_DIST regrow: a run of 254 integer keys sharing one hash,
+    // then a few keys sharing another hash whose home is the slot just
+    // before, which displace the whole run
+    dict::FlatDict<uint64_t, int, ThousandsHash> crowded;
+    crowded.reserve(259);
+    size_t nSlots = crowded.bucket_count();
+    uint64_t runGroup = 0, beforeGroup = 1;
+    while (crowded.bucket(beforeGroup * 1000) != (crowded.bucket(runGroup * 1000) + nSlots - 1) % nSlots) {
+        if (++beforeGroup == 10000) {
+            runGroup++;
+            beforeGroup = 0;
+        }
+    }
+    for (uint64_t i = 0; i < 254; i++) {
+        crowded[runGroup * 1000 + i] = 1;
+    }
+    for (uint64_t i = 0; i < 5; i++) {
+        crowded[beforeGroup * 1000 + i] = 0;
+    }
+    assert(crowded.size() == 259 and crowded.bucket_count() > nSlots);
+    for (uint64_t i = 0; i < 254; i++) {
+        assert(crowded.count(runGroup * 1000 + i) == 1 and crowded.at(runGroup * 1000 + i) == 1);
+    }
+    for (uint64_t i = 0; i < 5; i++) {
+        assert(crowded.count(beforeGroup * 1000 + i) == 1 and crowded.at(beforeGroup * 1000 + i) == 0);
+    }
+
+    v = {1, 1, 2, 3};
+    dict::FlatDict<float, unsigned> flatCounts;
+    dict::countElems(v.begin(), v.end(), flatCounts);
+    assert(flatCounts == dict::makeFlatDict(1.f, 2u, 2.f, 1u, 3.f, 1u));
+
+    thr::ThreadPool pool(4);
+    seq::execution::Policy par = {seq::execution::Policy::PARALLEL, &pool, 1000};
+
+    vector<unsigned char> pixels(100003);
+    for (size_t i = 0; i < pixels.size(); i++) {
+        pixels[i] = (unsigned char)(i * i % 251);
+    }
+    auto pixelCounts = dict::countElems(pixels.begin(), pixels.end());
+    assert(pixelCounts.size() == 126 and pixelCounts[0] == 399);
+    dict::Dict<unsigned char, unsigned> parPixelCounts;
+    assert(dict::countElems(par, pixels.begin(), pixels.end(), parPixelCounts) == pixelCounts);
+    unsigned byteCounts[256] = {0};
+    dict::countBytes(par, pixels.data(), pixels.size(), byteCounts);
+    for (size_t b = 0; b < 256; b++) {
+        assert(byteCounts[b] == (pixelCounts.count((unsigned char)b) ? pixelCounts[(unsigned char)b] : 0));
+    }
+
+    vector<short> shorts{-3, 7, -3, 300};
+    assert((dict::countElems(shorts.begin(), shorts.end()) == dict::makeDict<short, unsigned>(-3, 2, 7, 1, 300, 1)));
+    // enough shorts for the dense array, in parallel chunks smaller than it
+    vector<short> manyShorts(40000);
+    for (size_t i = 0; i < manyShorts.size(); i++) {
+        manyShorts[i] = short(int(i % 3000) - 1500);
+    }
+    auto shortCounts = dict::countElems(manyShorts.begin(), manyShorts.end());
+    assert(shortCounts.size() == 3000 and shortCounts[-1500] == 14 and shortCounts[1499] == 13);
+    dict::Dict<short, unsigned> parShortCounts;
+    assert(dict::countElems(par, manyShorts.begin(), manyShorts.end(), parShortCounts) == shortCounts);
+    vector<int> ints(50000);
+    for (size_t i = 0; i < ints.size(); i++) {
+        ints[i] = int(i % 1000) - 500;
+    }
+    dict::FlatDict<int, unsigned> intCounts;
+    dict::countElems(par, ints.begin(), ints.end(), intCounts);
+    assert(intCounts.size() == 1000 and intCounts.at(-500) == 50 and intCounts.at(499) == 50);
+    vector<unsigned> ranged;
+    dict::countElemsInRange(ints.begin(), ints.end(), -500, 500, ranged);
+    assert(ranged.size() == 1000 and ranged[0] == 50 and ranged[999] == 50);
+    bool threw = false;
+    try {
+        dict::countElemsInRange(ints.begin(), ints.end(), -500, 499, ranged);
+    } catch (out_of_range &) {
+        threw = true;
+    }
+    assert(threw);
+
+    dict::ConcurrentDict<int, int, hash<int>, equal_to<int>, dict::ShardStatsRecorder> shared(8);
+    assert(shared.nShards() == 8 and shared.insert(1, 10) and not shared.insert(1, 11));
+    int got = 0;
+    assert(shared.get(1, got) and got == 10 and not shared.get(2, got));
+    shared.upsert(1, 12);
+    shared.upsert(2, [](int &n) { n += 5; });
+    assert(shared.get(1, got) and got == 12 and shared.get(2, got) and got == 5);
+    assert(shared.getOrCompute(2, [](int) { return 0; }) == 5);
+    assert(shared.getOrCompute(3, [](int k) { return k * 3; }) == 9);
+    assert(shared.erase(3) == 1 and shared.erase(3) == 0 and not shared.contains(3));
+    shared.clear();
+    vector<thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.push_back(thread([&shared]() {
+            for (int i = 0; i < 1000; i++) {
+                shared.upsert(i, [](int &n) { n++; });
+                shared.getOrCompute(-i - 1, [](int k) { return k; });
+            }
+        }));
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+    assert(shared.size() == 2000);
+    shared.forEach([](const int &k, const int &n) { assert(k < 0 ? n == k : n == 4); });
+    unsigned long nReads = 0, nWrites = 0;
+    for (const dict::ShardStats &st : shared.stats()) {
+        assert(st.size > 0);
+        nReads += st.reads;
+        nWrites += st.writes;
+    }
+    assert(nReads >= 4000 and nWrites >= 5000);
+    dict::ConcurrentDict<int, int> uncounted(2);
+    uncounted.upsert(1, 1);
+    assert(uncounted.contains(1));
+    for (const dict::ShardStats &st : uncounted.stats()) {
+        assert(st.reads == 0 and st.writes == 0 and st.contended == 0);
+    }
+    threw = false;
+    try {
+        dict::ConcurrentDict<int, int> bad(6);
+    } catch (invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+
+    dict::LRUCache<int, string> lru(2);
+    lru.put(1, "a");
+    lru.put(2, "b");
+    string str;
+    assert(lru.get(1, str) and str == "a");
+    lru.put(3, "c");
+    assert(lru.size() == 2 and lru.contains(1) and not lru.contains(2));
+    assert(lru.find(2) == NULL and *lru.find(3) == "c");
+    lru.put(1, "A");
+    lru.put(4, "d");
+    assert(not lru.contains(3) and *lru.find(1) == "A");
+    dict::CacheStats cacheStats = lru.stats();
+    assert(cacheStats.hits == 3 and cacheStats.misses == 1 and cacheStats.evictions == 2);
+    assert(cacheStats.hitRate() == 0.75f);
+
+    // a hit gives an entry a second chance, so the unused one goes first
+    dict::ClockCache<int, int> clock(3);
+    for (int i = 0; i < 3; i++) {
+        clock.put(i, i * 10);
+    }
+    assert(*clock.find(0) == 0 and *clock.find(2) == 20);
+    clock.put(3, 30);
+    assert(clock.contains(0) and not clock.contains(1) and clock.contains(3));
+    assert(clock.getOrCompute(5, [](int k) { return k * 10; }) == 50 and clock.size() == 3);
+    assert(clock.stats().evictions == 2);
+
+    int nCalls = 0;
+    auto square = dict::memoize<int>([&nCalls](int x) { nCalls++; return x * x; }, 2);
+    assert(square(3) == 9 and square(3) == 9 and nCalls == 1);
+    square(4);
+    square(5);
+    assert(square(3) == 9 and nCalls == 4 and square.cache().stats().hits == 1);
+    auto cube = dict::memoizeClock<int>([](int x) { return x * x * x; }, 8);
+    assert(cube(2) == 8 and cube(2) == 8 and cube.cache().stats().hits == 1);
+    threw = false;
+    try {
+        dict::LRUCache<int, int> bad(0);
+    } catch (invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+
+    constexpr auto numbers = dict::makeStaticDict(NUMBERS);
+    static_assert(numbers.size() == 13, "");
+    for (const auto &entry : numbers) {
+        assert(numbers.at(entry.key) == entry.val and numbers.count(string(entry.key)) == 1);
+    }
+    assert(numbers.find("thirteen") == NULL and numbers.find("on") == NULL and numbers.count("twelve!") == 0);
+    assert(numbers.begin()->val == 1 and *numbers.find("seven", 5) == 7);
+    threw = false;
+    try {
+        numbers.at("zero");
+    } catch (out_of_range &) {
+        threw = true;
+    }
+    assert(threw);
+
+    constexpr auto optToChker = dict::makeStaticDict(CHKERS);
+    const char *argv[] = {"prog", "-n", "5", "pos", "-v", "-h"};
+    argparse::ArgHolder args = argparse::parse(6, argv, optToChker);
+    assert((args.optToArgs.at("-n") == vector<string>{"5"} and args.posArgs == vector<string>{"pos"}));
+    assert(args.optToArgs.count("-v") and args.optToArgs.count("-h"));
+    threw = false;
+    try {
+        const char *badArgv[] = {"prog", "-x"};
+        argparse::parse(2, badArgv, optToChker);
+    } catch (invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+
+    dict::FlatDict<string, int> names{{"one", 1}, {"two", 2}};
+    names.emplace("three", 3);
+    assert(names["two"] == 2 and names.size() == 3);
+    ostringstream printed;
+    printed << dict::makeFlatDict(string("k"), 1);
+    assert(printed.str() == "{<pair first=k second=1>}");
+
     return 0;
 }
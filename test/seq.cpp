@@ -0,0 +1,333 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cassert>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "../core.hpp"
+
+using namespace seq;
+
+int main() {
+    thr::ThreadPool pool(4);
+    // small chunks so even these inputs get split up
+    execution::Policy par = {execution::Policy::PARALLEL, &pool, 100};
+
+    vector<int> v(10000);
+    for (size_t i = 0; i < v.size(); i++) {
+        v[i] = int(i);
+    }
+    auto isEven = [](int n) { return n % 2 == 0; };
+    auto square = [](int n) { return n * n; };
+
+    assert(functional::map(par, square, v) == functional::map(square, v));
+    assert(functional::map(execution::SEQ, square, v) == functional::map(square, v));
+    assert(functional::filter(par, isEven, v) == functional::filter(isEven, v));
+    assert(functional::filter(execution::PAR, isEven, v) == functional::filter(isEven, v));
+
+    vector<int> inPlace(v);
+    functional::filter(par, isEven, inPlace, inPlace);
+    assert(inPlace == functional::filter(isEven, v));
+
+    assert(functional::any(par, [](int n) { return n == 9999; }, v));
+    assert(not functional::any(par, [](int n) { return n < 0; }, v));
+    assert(functional::all(par, [](int n) { return n >= 0; }, v));
+    assert(not functional::all(par, isEven, v));
+
+    // views
+    vector<int> small{1, 2, 3, 4, 5, 6};
+    auto evensSquared = view::map(square, view::filter(isEven, small));
+    assert((view::collect<vector<int>>(evensSquared) == vector<int>{4, 16, 36}));
+    assert((view::collect<vector<int>>(view::take(2, evensSquared)) == vector<int>{4, 16}));
+    assert((view::collect<vector<int>>(view::take(10, small)) == small));
+
+    vector<float> weights{0.5f, 2.f};
+    float dot = 0;
+    for (auto p : view::zip(small, weights)) {
+        dot += float(p.first) * p.second;
+    }
+    assert(dot == 4.5f);
+
+    size_t nEnumerated = 0;
+    for (auto p : view::enumerate(view::filter(isEven, small))) {
+        assert(p.second == int(2 * p.first + 2));
+        nEnumerated++;
+    }
+    assert(nEnumerated == 3);
+
+    // ranges
+    static_assert(math::xrange(10).size() == 10, "");
+    static_assert(math::xrange(0, 10, 3)[3] == 9, "");
+    static_assert(math::xrange(0, 9, 3, true).size() == 4, "");
+    static_assert(math::xrange(10, 0, -2).size() == 5, "");
+    static_assert(math::xrange(5, 5).empty(), "");
+    assert(math::xrange(0., 1., .1).size() == 10);
+    assert(math::xrange(0., 1., .1, true).size() == 11);
+    assert(math::xrange(0., 1., .1)[7] == 7 * .1);
+
+    auto r = math::xrange(size_t(3), size_t(103));
+    assert(r.end() - r.begin() == 100);
+    assert(*lower_bound(r.begin(), r.end(), size_t(50)) == 50);
+    size_t nCovered = 0;
+    size_t expectedStart = 3;
+    for (auto part : r.split(7)) {
+        assert(part.size() == 14 or part.size() == 15);
+        assert(part[0] == expectedStart);
+        expectedStart += part.size();
+        nCovered += part.size();
+    }
+    assert(nCovered == 100);
+    assert(math::xrange(3).split(8).size() == 3);
+
+    atomic<size_t> rangeSum(0);
+    math::parallelFor(par, math::xrange(size_t(1000)), [&](size_t i) { rangeSum += i; });
+    assert(rangeSum == 999 * 1000 / 2);
+
+    // 2D/ND ranges
+    for (auto order : {math::ROW_MAJOR, math::TILED, math::MORTON}) {
+        auto grid = math::xrange2d(13, 21, order, 5);
+        vector<int> seen(13 * 21);
+        size_t nVisited = 0;
+        for (auto p : grid) {
+            seen[p[0] * 21 + p[1]]++;
+            nVisited++;
+        }
+        assert(nVisited == grid.size());
+        assert(functional::all([](int n) { return n == 1; }, seen));
+
+        size_t nInTiles = 0;
+        for (auto t : grid.tiles()) {
+            assert(t.high[0] - t.low[0] <= grid.tile and t.high[1] - t.low[1] <= grid.tile);
+            nInTiles += t.size();
+        }
+        assert(nInTiles == grid.size());
+    }
+    typedef array<size_t, 2> P2;
+    auto zGrid = math::xrange2d(4, 4, math::MORTON, 4);
+    auto z = zGrid.begin();
+    assert(*z++ == (P2{{0, 0}}) and *z++ == (P2{{0, 1}}) and *z++ == (P2{{1, 0}}));
+    assert(*z++ == (P2{{1, 1}}) and *z == (P2{{0, 2}}));
+    auto tiledGrid = math::xrange2d(4, 4, math::TILED, 2);
+    auto tiled = tiledGrid.begin();
+    advance(tiled, 4);
+    assert(*tiled == (P2{{0, 2}}));
+    auto zBox = math::xrangeND(array<size_t, 3>{{2, 3, 4}}, math::MORTON);
+    assert(zBox.size() == 24 and zBox.tile == 4);
+    typedef array<size_t, 3> P3;
+    vector<P3> zPoints(zBox.begin(), zBox.end());
+    // the first 2x2x2 block, then on along the last dimension
+    assert((vector<P3>(zPoints.begin(), zPoints.begin() + 9) == vector<P3>{
+            {{0, 0, 0}}, {{0, 0, 1}}, {{0, 1, 0}}, {{0, 1, 1}},
+            {{1, 0, 0}}, {{1, 0, 1}}, {{1, 1, 0}}, {{1, 1, 1}}, {{0, 0, 2}}}));
+    assert(zPoints.back() == (P3{{1, 2, 3}}));
+    sort(zPoints.begin(), zPoints.end());
+    assert(unique(zPoints.begin(), zPoints.end()) == zPoints.end() and zPoints.size() == 24);
+    for (auto &p : zPoints) {
+        assert(p[0] < 2 and p[1] < 3 and p[2] < 4);
+    }
+    assert(math::xrange2d(0, 5).begin() == math::xrange2d(0, 5).end());
+
+    // clustering
+    typedef pair<int, int> Pt;
+    vector<Pt> pts;
+    unsigned seed = 12345;
+    for (size_t i = 0; i < 500; i++) {
+        seed = seed * 1103515245 + 12345;
+        int x = int(seed >> 16) % 100;
+        seed = seed * 1103515245 + 12345;
+        pts.push_back(Pt(x, int(seed >> 16) % 100));
+    }
+    auto ptDistSqrd = [](const Pt &a, const Pt &b) {
+        int dx = a.first - b.first;
+        int dy = a.second - b.second;
+        return float(dx * dx + dy * dy);
+    };
+    auto ptPos = [](const Pt &p) { return kmath::Point<int>(p.first, p.second); };
+    vector<vector<Pt>> slowClusters, fastClusters, singleClusters;
+    cluster(pts, ptDistSqrd, 25.f, slowClusters);
+    clusterPoints(pts, ptPos, 5.f, fastClusters);
+    assert(fastClusters == slowClusters);
+
+    clusterPoints(pts, ptPos, 5.f, singleClusters, SINGLE);
+    assert(singleClusters.size() <= fastClusters.size());
+    size_t nClustered = 0;
+    for (auto &c : singleClusters) {
+        nClustered += c.size();
+    }
+    assert(nClustered == pts.size());
+
+    vector<Pt> line{Pt(0, 0), Pt(0, 4), Pt(0, 8), Pt(0, 20)};
+    clusterPoints(line, ptPos, 5.f, singleClusters, SINGLE);
+    assert((singleClusters == vector<vector<Pt>>{{Pt(0, 0), Pt(0, 4), Pt(0, 8)}, {Pt(0, 20)}}));
+    clusterPoints(line, ptPos, 5.f, fastClusters);
+    assert(fastClusters.size() == 3);
+
+    // element-wise arithmetic
+    vector<int> scaled = small * 2 / 3;
+    assert((scaled == vector<int>{0, 1, 2, 2, 3, 4}));
+    vector<double> ones(6, 1.);
+    vector<double> halves;
+    assign(halves, 1. / (small + small) - 0.5 * ones);
+    assert(halves[0] == 0 and halves[1] == -0.25);
+    vector<float> combined;
+    assign(combined, (small - 1) * weights[1] + 0.5f);
+    assert((combined == vector<float>{0.5f, 2.5f, 4.5f, 6.5f, 8.5f, 10.5f}));
+    assert((vector<int>(small * 0.5 * 2) == small));
+    // sequences without random access are still computed eagerly
+    list<int> lst{1, 2, 3};
+    list<int> lstScaled = lst * 2;
+    assert((lstScaled == list<int>{2, 4, 6} and 6 / lstScaled == list<int>{3, 1, 1}));
+    // temporaries are moved into the expression, so this doesn't dangle
+    auto fromTemp = vector<int>{1, 2, 3} * 2 + small[1];
+    assert((vector<int>(fromTemp) == vector<int>{4, 6, 8}));
+    bool threw = false;
+    try {
+        small + weights;
+    } catch (invalid_argument &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // wrap-around access
+    vector<int> ring5{0, 1, 2, 3, 4};
+    WrappedSeq<vector<int>> wrapped(ring5);
+    RingView<vector<int>> ringView(ring5);
+    PaddedRing<int> padded(ring5, 7);
+    for (int i = -12; i < 12; i++) {
+        int expected = ((i % 5) + 5) % 5;
+        assert(wrapped[i] == expected and ringView[i] == expected);
+        assert(i < -7 or padded[i] == expected);
+    }
+    vector<int> ring4{0, 1, 2, 3};
+    RingView<vector<int>> pow2View(ring4);
+    assert(pow2View[-1] == 3 and pow2View[6] == 2 and pow2View.realI(-4) == 0);
+    vector<int> emptySeq;
+    WrappedSeq<vector<int>> wrappedEmpty(emptySeq);
+    threw = false;
+    try {
+        wrappedEmpty[3];
+    } catch (length_error &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // small vectors
+    SmallVec<string, 2> words{"a", "b"};
+    assert(words.isInline());
+    words.push_back(words[0]);
+    words.emplace_back(size_t(3), 'c');
+    assert(not words.isInline() and words.size() == 4 and words.back() == "ccc");
+    SmallVec<string, 2> movedWords(move(words));
+    assert(words.empty() and words.isInline() and movedWords[2] == "a");
+    movedWords.erase(movedWords.begin() + 1);
+    assert((movedWords == SmallVec<string, 2>{"a", "a", "ccc"}));
+
+    SmallVec<int, 8> smallInts(small.begin(), small.end());
+    SmallVec<int, 8> inlineCopy(smallInts);
+    SmallVec<int, 8> movedInts(move(inlineCopy));
+    assert(movedInts.isInline() and movedInts == smallInts);
+    assert((functional::filter(isEven, smallInts) == SmallVec<int, 8>{2, 4, 6}));
+    assert((functional::map(square, smallInts)[5] == 36));
+    vector<SmallVec<Pt, 4>> smallClusters;
+    clusterPoints(line, ptPos, 5.f, smallClusters);
+    assert(smallClusters.size() == 3 and smallClusters[0].isInline());
+
+    // sorting
+    vector<int> ints(5000);
+    vector<float> floats(5000);
+    for (size_t i = 0; i < ints.size(); i++) {
+        seed = seed * 1103515245 + 12345;
+        ints[i] = int(seed) / 3;
+        floats[i] = float(ints[i]) / 1000.f;
+    }
+    floats[7] = -0.f;
+    vector<int> expectedInts(ints);
+    sort(expectedInts.begin(), expectedInts.end());
+    vector<float> expectedFloats(floats);
+    sort(expectedFloats.begin(), expectedFloats.end());
+
+    vector<int> radixInts(ints);
+    radixSort(radixInts);
+    assert(radixInts == expectedInts);
+    vector<float> radixFloats(floats);
+    radixSort(radixFloats);
+    assert(radixFloats == expectedFloats);
+    vector<int> mergedInts(ints);
+    mergeSort(par, mergedInts);
+    assert(mergedInts == expectedInts);
+
+    // stability: sort by the last digit, earlier elements first among equals
+    vector<pair<int, size_t>> tagged;
+    for (size_t i = 0; i < ints.size(); i++) {
+        tagged.push_back(make_pair(ints[i] % 10, i));
+    }
+    vector<pair<int, size_t>> byKey(tagged), byMerge(tagged), expectedTagged(tagged);
+    auto firstLess = [](const pair<int, size_t> &a, const pair<int, size_t> &b) { return a.first < b.first; };
+    stable_sort(expectedTagged.begin(), expectedTagged.end(), firstLess);
+    radixSort(byKey, [](const pair<int, size_t> &p) { return p.first; });
+    assert(byKey == expectedTagged);
+    mergeSort(par, byMerge, firstLess);
+    assert(byMerge == expectedTagged);
+
+    vector<int> topK(ints);
+    partialSort(topK, 10, greater<int>());
+    assert(equal(topK.begin(), topK.begin() + 10, expectedInts.rbegin()));
+    vector<int> nth(ints);
+    assert(nthElement(nth, 2500) == expectedInts[2500]);
+    threw = false;
+    try {
+        nthElement(nth, nth.size());
+    } catch (out_of_range &) {
+        threw = true;
+    }
+    assert(threw);
+
+    // reductions
+    assert(math::sum(small) == 21);
+    assert(math::sum(evensSquared) == 56);
+    assert(math::dot(small, small) == 91);
+    assert(math::minMax(small) == make_pair(1, 6));
+
+    vector<double> d(1001);
+    for (size_t i = 0; i < d.size(); i++) {
+        d[i] = double(i) - 500;
+    }
+    assert(math::sum(d) == 0);
+    assert(math::mean(d, math::PAIRWISE) == 0);
+    assert(math::sumOfSquares(d) == math::dot(d, d));
+    assert(math::minMax(d) == make_pair(-500., 500.));
+
+    // 1 + n * eps / 4 rounds back to 1 in every step of a naive float sum
+    vector<float> tiny(1 << 16, 1e-8f);
+    tiny[0] = 1;
+    double exact = 1 + double(tiny.size() - 1) * 1e-8;
+    assert(abs(math::sum(tiny, math::KAHAN) - exact) < 1e-6);
+    assert(abs(math::sum(tiny, math::PAIRWISE) - exact) < 1e-5);
+
+    return 0;
+}
@@ -0,0 +1,340 @@
+/*
+Copyright (c) 2012, Kevin Han
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+    Redistributions of source code must retain the above copyright notice, this
+    list of conditions and the following disclaimer.
+
+    Redistributions in binary form must reproduce the above copyright notice,
+    this list of conditions and the following disclaimer in the documentation
+    and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "../core.hpp"
+#include "../src/mouse.hpp"
+
+int main() {
+    bool threw;
+    thr::Queue<int, thr::StatsRecorder> q(2);
+    int out = 0;
+    assert(not q.poll(out));
+    assert(q.push(1) and q.tryPush(2));
+    assert(not q.tryPush(3));
+    assert(q.poll(out) and out == 1);
+    assert(q.waitFor(out, chrono::milliseconds(1)) and out == 2);
+    assert(not q.waitFor(out, chrono::milliseconds(1)));
+
+    // close() wakes a blocked consumer, and leftover items are drained first
+    thread consumer([&]() {
+        int item;
+        assert(q.wait(item) and item == 4);
+        assert(not q.wait(item));
+    });
+    q.push(4);
+    q.close();
+    consumer.join();
+    assert(not q.push(5));
+
+    thr::QueueStats qStats = q.stats();
+    assert(qStats.pushes == 3 and qStats.pops == 3 and qStats.highWater == 2);
+    unsigned long nTimed = 0;
+    for (auto n : qStats.queueTimeHist) {
+        nTimed += n;
+    }
+    assert(nTimed == 3);
+
+    // without a recorder, stats cost nothing and read as zeros
+    thr::Queue<int> plainQ;
+    plainQ.push(1);
+    assert(plainQ.stats().pushes == 0 and plainQ.stats().highWater == 0);
+    assert(sizeof(thr::SPSCQueue<int>) < sizeof(thr::SPSCQueue<int, thr::StatsRecorder>));
+
+    thr::Queue<int> dropNewest(1, thr::DROP_NEWEST), dropOldest(1, thr::DROP_OLDEST);
+    dropNewest.push(1);
+    dropNewest.push(2);
+    dropOldest.push(1);
+    dropOldest.push(2);
+    assert(dropNewest.poll(out) and out == 1 and dropNewest.dropped == 1);
+    assert(dropOldest.poll(out) and out == 2 and dropOldest.dropped == 1);
+
+    thr::Pipeline<int> pipe(100);
+    threw = false;
+    try {
+        pipe.push(0);
+    } catch (logic_error &err) {
+        threw = true;
+    }
+    assert(threw);
+    pipe.addStage("double", [](int &n) { n *= 2; return true; });
+    pipe.addStage("odd", [](int &n) { return n % 4 != 0; });
+    threw = false;
+    try {
+        pipe.push(0);
+    } catch (logic_error &err) {
+        threw = true;
+    }
+    assert(threw);
+    pipe.start();
+    for (int i = 0; i < 10; i++) {
+        pipe.push(i);
+    }
+    pipe.stop();
+    vector<int> piped;
+    while (pipe.wait(out)) {
+        piped.push_back(out);
+    }
+    assert((piped == vector<int>{2, 6, 10, 14, 18}));
+    auto stats = pipe.stats();
+    assert(stats.size() == 2 and stats[1].name == "odd");
+    assert(stats[0].processed == 10 and stats[1].discarded == 5);
+
+    // items are moved between stages, so move-only types work
+    thr::Pipeline<unique_ptr<int>> ptrPipe;
+    ptrPipe.addStage("inc", [](unique_ptr<int> &p) { ++*p; return true; });
+    ptrPipe.addStage("dbl", [](unique_ptr<int> &p) { *p *= 2; return true; });
+    ptrPipe.start();
+    ptrPipe.push(unique_ptr<int>(new int(3)));
+    ptrPipe.stop();
+    unique_ptr<int> ptrOut;
+    assert(ptrPipe.wait(ptrOut) and *ptrOut == 8);
+
+    thr::Published<mouse::State> pubState;
+    assert(pubState.version() == 1);
+    pubState.store(mouse::State(mouse::State::LEFT_DOWN, kmath::PointI(3, 4)));
+    mouse::State state = pubState.load();
+    assert(state.btn == mouse::State::LEFT_DOWN and state.pos.x == 3 and state.pos.y == 4);
+    assert(pubState.version() == 2);
+
+    // readers never see a torn value
+    thr::Published<kmath::Point<long>> pubPt;
+    thread writer([&]() {
+        for (long i = 1; i <= 100000; i++) {
+            pubPt.store(kmath::Point<long>(i, -i));
+        }
+    });
+    for (int i = 0; i < 100000; i++) {
+        auto pt = pubPt.load();
+        assert(pt.x == -pt.y);
+    }
+    writer.join();
+
+    // writers exclude each other and readers; readers share
+    thr::SharedSpinLock rw;
+    assert(rw.try_lock_shared() and rw.try_lock_shared() and not rw.try_lock());
+    rw.unlock_shared();
+    rw.unlock_shared();
+    assert(rw.try_lock() and not rw.try_lock_shared());
+    rw.unlock();
+    long guarded[2] = {0, 0};
+    vector<thread> rwThreads;
+    for (int t = 0; t < 4; t++) {
+        rwThreads.push_back(thread([&, t]() {
+            for (int i = 0; i < 20000; i++) {
+                if (t == 0) {
+                    lock_guard<thr::SharedSpinLock> lk(rw);
+                    guarded[0]++;
+                    guarded[1]--;
+                } else {
+                    thr::SharedLockGuard<thr::SharedSpinLock> lk(rw);
+                    assert(guarded[0] == -guarded[1]);
+                }
+            }
+        }));
+    }
+    for (auto &t : rwThreads) {
+        t.join();
+    }
+    assert(guarded[0] == 20000);
+
+    thr::RingQueue<int> rq(4);
+    assert(not rq.poll(out));
+    for (int i = 0; i < 4; i++) {
+        assert(rq.tryPush(i));
+    }
+    assert(not rq.tryPush(4));
+    for (int i = 0; i < 4; i++) {
+        assert(rq.poll(out) and out == i);
+    }
+    assert(not rq.poll(out));
+
+    threw = false;
+    try {
+        thr::RingQueue<int> bad(3);
+    } catch (invalid_argument &err) {
+        threw = true;
+    }
+    assert(threw);
+
+    thr::SPSCQueue<vector<int>> sq(4);
+    vector<int> big(100, 7);
+    sq.push(move(big));
+    assert(sq.poll(big) and big.size() == 100);
+    vector<int> batch[6];
+    for (int i = 0; i < 6; i++) {
+        batch[i].push_back(i);
+    }
+    assert(sq.pushN(batch, 6) == 4);
+    assert(sq.popN(batch, 6) == 4);
+    assert(batch[3] == vector<int>{3});
+    assert(not sq.poll(big));
+
+    thr::Mailbox<int> box;
+    assert(not box.poll(out));
+    box.push(1);
+    box.push(2);
+    box.push(3);
+    assert(box.poll(out) and out == 3);
+    assert(not box.poll(out));
+    assert(box.published() == 3 and box.dropped() == 2);
+    box.writeSlot() = 4;
+    box.publish();
+    assert(box.update() and box.latest() == 4);
+
+    // poll() doesn't hand a buffer the consumer still holds back to the
+    // producer
+    thr::Mailbox<shared_ptr<int>> ptrBox;
+    shared_ptr<int> ptr;
+    ptrBox.push(make_shared<int>(1));
+    assert(ptrBox.poll(ptr) and *ptr == 1);
+    shared_ptr<int> kept = ptr;
+    ptrBox.push(make_shared<int>(2));
+    assert(ptrBox.poll(ptr) and *ptr == 2);
+    assert(*kept == 1 and kept.use_count() == 1);
+
+    thr::ThreadPool pool(4);
+    assert(pool.submit([](int a, int b) { return a + b; }, 2, 3).get() == 5);
+
+    vector<int> counts(1000, 0);
+    pool.parallelFor(0, counts.size(), 7, [&](size_t i) {
+        // nested loops must not deadlock
+        pool.parallelFor(0, 3, 1, [&](size_t j) {
+            if (j == 0) {
+                counts[i]++;
+            }
+        });
+    });
+    for (int n : counts) {
+        assert(n == 1);
+    }
+
+    threw = false;
+    try {
+        pool.parallelFor(0, 100, 1, [](size_t i) {
+            if (i == 50) {
+                throw runtime_error("failed");
+            }
+        });
+    } catch (runtime_error &err) {
+        threw = true;
+    }
+    assert(threw);
+
+    {
+        thr::Scheduler sched(pool);
+        atomic<int> nOnce(0), nPeriodic(0), nCancelled(0);
+        sched.after(chrono::milliseconds(5), [&]() { nOnce++; });
+        auto periodicId = sched.every(chrono::milliseconds(2), [&]() { nPeriodic++; });
+        auto cancelledId = sched.after(chrono::milliseconds(5), [&]() { nCancelled++; });
+        // far enough away to land on a higher wheel level
+        auto farId = sched.after(chrono::seconds(100), [&]() { nCancelled++; });
+        assert(sched.size() == 4);
+        assert(sched.cancel(cancelledId) and not sched.cancel(cancelledId));
+        this_thread::sleep_for(chrono::milliseconds(50));
+        assert(sched.cancel(periodicId) and sched.cancel(farId));
+        while (pool.runPending());
+        this_thread::sleep_for(chrono::milliseconds(10));
+        assert(nOnce == 1 and nPeriodic >= 5 and nCancelled == 0);
+        assert(sched.size() == 0);
+    }
+
+    {
+        // periods shorter than a tick round up to one tick rather than
+        // turning into one-shots
+        thr::Scheduler sched(pool);
+        atomic<int> nFast(0);
+        auto fastId = sched.every(chrono::microseconds(100), [&]() { nFast++; });
+        this_thread::sleep_for(chrono::milliseconds(30));
+        assert(sched.cancel(fastId) and nFast >= 3);
+    }
+
+    // a pool task posted in place is run without being freed
+    struct CountTask : thr::PoolTask {
+        atomic<int> n;
+        CountTask() : n(0) {}
+        void run() { this->n++; }
+    } counter;
+    for (int i = 0; i < 3; i++) {
+        pool.post(counter);
+        while (counter.n != i + 1) {
+            pool.runPending();
+        }
+    }
+
+    thr::CpuTopology topo = thr::CpuTopology::detect();
+    assert(topo.order(thr::NO_PINNING).empty());
+    assert(not topo.order(thr::COMPACT).empty());
+    assert(not topo.order(thr::SCATTER).empty());
+    assert(topo.order(thr::COMPACT).size() == topo.nCpus);
+    assert(not thr::pinThread(vector<unsigned>{1u << 20}));
+    thr::ThreadPool pinnedPool(2, thr::COMPACT);
+    assert(pinnedPool.submit([]() { return 1; }).get() == 1);
+
+    // every pushed item is received exactly once across producers/consumers
+    const int nPerThread = 10000;
+    thr::RingQueue<int, thr::StatsRecorder> shared(64);
+    vector<int> seen(4 * nPerThread, 0);
+    vector<thread> threads;
+    for (int p = 0; p < 4; p++) {
+        threads.push_back(thread([&, p]() {
+            for (int i = 0; i < nPerThread; i++) {
+                shared.push(p * nPerThread + i);
+            }
+        }));
+    }
+    vector<vector<int>> received(4);
+    for (int c = 0; c < 4; c++) {
+        threads.push_back(thread([&, c]() {
+            int item;
+            for (int i = 0; i < nPerThread; i++) {
+                shared.wait(item);
+                received[size_t(c)].push_back(item);
+            }
+        }));
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    for (auto &items : received) {
+        for (int item : items) {
+            seen[size_t(item)]++;
+        }
+    }
+    for (int n : seen) {
+        assert(n == 1);
+    }
+    // the high-water mark stays sane while consumers race producers
+    assert(shared.stats().highWater > 0 and shared.stats().highWater <= shared.capacity());
+
+    return 0;
+}